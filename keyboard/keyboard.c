@@ -21,26 +21,45 @@
 // SOFTWARE.
 
 #include "keyboard.h"
+#include "keyboard_ramfunc.h"
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <string.h>
 
-
-static const uint8_t key_table[] =
-{
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,  // CRSR DOWN, F5, F3, F1, F7, CRSR RIGHT, RETURN, INST DEL
-    0xff, 0x05, 0x13, 0x1a, 0x34, 0x01, 0x17, 0x33,  // LEFT SHIFT, "E", "S", "Z", "4", "A", "W", "3"
-    0x18, 0x14, 0x06, 0x03, 0x36, 0x04, 0x12, 0x35,  // "X", "T", "F", "C", "6", "D", "R", "5"
-    0x16, 0x15, 0x08, 0x02, 0x38, 0x07, 0x19, 0x37,  // "V", "U", "H", "B", "8", "G", "Y", "7"
-    0x0e, 0x0f, 0x0b, 0x0d, 0x30, 0x0a, 0x09, 0x39,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
-    0x2c, 0x00, 0x3a, 0x2e, 0x2d, 0x0c, 0x10, 0x2b,  // ",", "@", ":", ".", "-", "L", "P", "+"
-    0x2f, 0x1e, 0x3d, 0xff, 0xff, 0x3b, 0x2a, 0x1c,  // "/", "^", "=", RIGHT SHIFT, HOME, ";", "*", "£"
-    0xff, 0x11, 0xff, 0x20, 0x32, 0xff, 0x1f, 0x31,  // RUN STOP, "Q", "C=" (CMD), " " (SPC), "2", "CTRL", "<-", "1"
-};
-
-static enum keyboard_scan_return keyboard_key_in_row(struct keyboard_ctx* ctx, int index, uint32_t scan_result);
-static uint8_t keyboard_rotate_left(uint8_t data);
+#if defined(KEYBOARD_HAL_STATIC)
+// Port accessors are inlined from the board header instead of called through the context
+#include "boards.h"
+
+#define KEYBOARD_PA_OUT_WRITE(ctx, value)   keyboard_hal_pa_out_write(value)
+#define KEYBOARD_PB_IN_READ(ctx)            keyboard_hal_pb_in_read()
+#else
+#define KEYBOARD_PA_OUT_WRITE(ctx, value)   (ctx)->pa_out_write(value)
+#define KEYBOARD_PB_IN_READ(ctx)            (ctx)->pb_in_read()
+#endif
+
+
+static bool keyboard_scan_strobe_start(struct keyboard_ctx* ctx);
+static void keyboard_scan_wait(struct keyboard_ctx* ctx);
+static void keyboard_scan_groups_start(struct keyboard_ctx* ctx);
+static bool keyboard_scan_groups_next(struct keyboard_ctx* ctx);
+static void keyboard_scan_group_push(struct keyboard_ctx* ctx, uint8_t rows, uint8_t sibling_cols);
+static int keyboard_settle_row(const struct keyboard_ctx* ctx);
+static bool keyboard_scan_forward_done(struct keyboard_ctx* ctx);
+static void keyboard_scan_reverse_done(struct keyboard_ctx* ctx);
+static void keyboard_scan_done(struct keyboard_ctx* ctx, uint64_t raw);
+static uint32_t keyboard_scan_extra_rows(struct keyboard_ctx* ctx);
+static void keyboard_evaluate_extra_rows(struct keyboard_ctx* ctx);
+static void keyboard_evaluate_extra(struct keyboard_ctx* ctx);
+static struct keyboard_return keyboard_evaluate(struct keyboard_ctx* ctx, uint64_t matrix);
+static void keyboard_scan_finish(struct keyboard_ctx* ctx, struct keyboard_return keyboard_return);
+static void keyboard_row_time(struct keyboard_ctx* ctx, uint8_t rows);
+static int keyboard_press_order(const struct keyboard_ctx* ctx, uint64_t keys, uint8_t* order);
+static uint32_t keyboard_press_estimate(const struct keyboard_ctx* ctx, int row);
+static bool keyboard_time_before(const struct keyboard_ctx* ctx, uint32_t a, uint32_t b);
+static void keyboard_post_events(struct keyboard_ctx* ctx, const uint8_t* order, int count);
+static void keyboard_post_keys(struct keyboard_ctx* ctx, uint64_t keys, bool pressed, uint32_t timestamp, unsigned int base);
+static void keyboard_post_event(struct keyboard_ctx* ctx, unsigned int key, bool pressed, uint32_t timestamp);
+static uint8_t keyboard_matrix_row(uint64_t matrix, int row);
 
 
 void keyboard_init(struct keyboard_ctx* ctx, const struct keyboard_init_data* init)
@@ -49,150 +68,594 @@ void keyboard_init(struct keyboard_ctx* ctx, const struct keyboard_init_data* in
     ctx->pb_cfg_input_pull_high = init->pb_cfg_input_pull_high;
     ctx->pa_out_write = init->pa_out_write;
     ctx->pb_in_read = init->pb_in_read;
+    ctx->settle_wait = init->settle_wait;
+    ctx->scan_complete = init->scan_complete;
+    ctx->matrix_scan_start = init->matrix_scan_start;
+    ctx->events = init->events;
+    ctx->timestamp = init->timestamp;
+    ctx->timestamp_mask = init->timestamp_mask ? init->timestamp_mask : UINT32_MAX;
+    ctx->incremental_scan = init->incremental_scan;
+    ctx->pb_cfg_output = init->pb_cfg_output;
+    ctx->pa_cfg_input_pull_high = init->pa_cfg_input_pull_high;
+    ctx->pb_out_write = init->pb_out_write;
+    ctx->pa_in_read = init->pa_in_read;
+    ctx->extra_in_read = init->extra_in_read;
+    ctx->profile = init->profile ? init->profile : &keyboard_profile_c64;
+    ctx->extra_row_read = init->extra_row_read;
 
     // Set port direction
     ctx->pa_cfg_output();
     ctx->pb_cfg_input_pull_high();
 
-    memset(ctx->buffer_old, 0xFF, sizeof(ctx->buffer_old));
-    memset(ctx->buffer, 0xFF, sizeof(ctx->buffer));
-    ctx->buffer_quantity = -1;
+    ctx->alpha_mask = keyboard_profile_alpha_mask(ctx->profile);
+
+    ctx->raw = 0;
+    ctx->extra = 0;
+    ctx->extra_latched = 0;
+    ctx->extra_state = 0;
+    ctx->raw_extra_rows = 0;
+    ctx->matrix_extra_rows = 0;
+    ctx->raw_only = false;
+    ctx->confirmed = 0;
+    ctx->matrix = 0;
+    ctx->pending_count = 0;
+    ctx->pending_drops = 0;
+    ctx->ghosts = 0;
+    ctx->scan_state = SCAN_STATE_IDLE;
+
+    for (int row = 0; row < 8; row++)
+    {
+        ctx->row_time[row] = 0;
+        ctx->row_time_prev[row] = 0;
+    }
+
+    keyboard_debounce_init(&ctx->debounce, init->debounce_mode, init->debounce_scans);
+    keyboard_debounce_init(&ctx->debounce_extra_rows, init->debounce_mode, init->debounce_scans);
 }
 
-struct keyboard_return keyboard_scan(struct keyboard_ctx* ctx)
+KEYBOARD_RAMFUNC struct keyboard_return keyboard_scan(struct keyboard_ctx* ctx)
 {
-    struct keyboard_return keyboard_return = {0};
+    if (ctx->matrix_scan_start)
+    {
+        keyboard_scan_start(ctx);
+        return (struct keyboard_return) {SCAN_RETURN_SCAN_PENDING};
+    }
 
-    // Connect all Keyboard rows
-    ctx->pa_out_write(0);
+    // Completes a pending split-phase scan if there is one
+    keyboard_scan_strobe_start(ctx);
+    keyboard_scan_wait(ctx);
+
+    return ctx->scan_return;
+}
+
+bool keyboard_scan_raw(struct keyboard_ctx* ctx, struct keyboard_raw* raw)
+{
+    if (ctx->matrix_scan_start)
+        return false;
+
+    // A pending split-phase scan is completed and decoded first
+    if (ctx->scan_state != SCAN_STATE_IDLE)
+        keyboard_scan_wait(ctx);
+
+    ctx->raw_only = true;
+    keyboard_scan_strobe_start(ctx);
+    keyboard_scan_wait(ctx);
+    ctx->raw_only = false;
+
+    *raw = (struct keyboard_raw) {ctx->raw, ctx->extra, ctx->raw_extra_rows};
+    return true;
+}
+
+KEYBOARD_RAMFUNC bool keyboard_scan_start(struct keyboard_ctx* ctx)
+{
+    if (!ctx->matrix_scan_start)
+        return keyboard_scan_strobe_start(ctx);
 
-    // Check for port activity
-    if (ctx->pb_in_read() == 0xFF)
+    if (ctx->scan_state != SCAN_STATE_IDLE || !ctx->matrix_scan_start())
+        return false;
+
+    ctx->scan_state = SCAN_STATE_MATRIX;
+    return true;
+}
+
+KEYBOARD_RAMFUNC bool keyboard_scan_continue(struct keyboard_ctx* ctx)
+{
+    switch (ctx->scan_state)
     {
-        ctx->simultaneous_alphanumeric_keys_flag = false;
-        memset(ctx->buffer_old, 0xFF, sizeof(ctx->buffer_old));
-        keyboard_return.keyboard_scan_return = SCAN_RETURN_NO_ACTIVITY;
-        return keyboard_return;
+        case SCAN_STATE_ACTIVITY_CHECK:
+            // Nothing down, the matrix is known without strobing the rows
+            if (KEYBOARD_PB_IN_READ(ctx) == 0xFF)
+            {
+                keyboard_row_time(ctx, 0xFF);
+                keyboard_scan_done(ctx, 0);
+                return false;
+            }
+
+            // Scan keyboard matrix, one row per settle period
+            ctx->scan_row = 0;
+            ctx->matrix_scan = 0;
+            KEYBOARD_PA_OUT_WRITE(ctx, 0xFE);
+            ctx->scan_state = SCAN_STATE_ROW;
+            return true;
+
+        case SCAN_STATE_ROW:
+            ctx->matrix_scan |= (uint64_t) (KEYBOARD_PB_IN_READ(ctx) ^ 0xFF) << (8 * ctx->scan_row);
+            keyboard_row_time(ctx, 1 << ctx->scan_row);
+
+            if (ctx->scan_row < 7)
+            {
+                ctx->scan_row++;
+                KEYBOARD_PA_OUT_WRITE(ctx, ~(1 << ctx->scan_row));
+                return true;
+            }
+
+            return keyboard_scan_forward_done(ctx);
+
+        case SCAN_STATE_GROUP:
+            ctx->scan_groups[ctx->scan_group_count - 1].cols = KEYBOARD_PB_IN_READ(ctx) ^ 0xFF;
+            ctx->scan_groups[ctx->scan_group_count - 1].known = true;
+            keyboard_row_time(ctx, ctx->scan_groups[ctx->scan_group_count - 1].rows);
+
+            if (keyboard_scan_groups_next(ctx))
+                return true;
+
+            return keyboard_scan_forward_done(ctx);
+
+        case SCAN_STATE_REVERSE:
+            // Strobing column scan_row, the rows read low are transposed into the matrix
+            for (uint8_t rows = ctx->pa_in_read() ^ 0xFF; rows; rows &= rows - 1)
+                ctx->matrix_reverse |= KEYBOARD_MATRIX_BIT(__builtin_ctz(rows), ctx->scan_row);
+
+            if (ctx->scan_row < 7)
+            {
+                ctx->scan_row++;
+                ctx->pb_out_write(~(1 << ctx->scan_row));
+                return true;
+            }
+
+            keyboard_scan_reverse_done(ctx);
+            return false;
+
+        default:
+            return false;
     }
+}
+
+KEYBOARD_RAMFUNC void keyboard_scan_matrix(struct keyboard_ctx* ctx, uint64_t matrix)
+{
+    // The backend reads all rows within one sequence, too close together to tell apart
+    keyboard_row_time(ctx, 0xFF);
+    keyboard_scan_done(ctx, matrix);
+}
 
-    // Wait for  all keys to be released before accepting new input
-    if (ctx->simultaneous_alphanumeric_keys_flag)
+KEYBOARD_RAMFUNC void keyboard_extra_latch(struct keyboard_ctx* ctx, uint8_t lines)
+{
+    __atomic_fetch_or(&ctx->extra_latched, lines, __ATOMIC_RELEASE);
+}
+
+KEYBOARD_RAMFUNC uint64_t keyboard_ghost_mask(uint64_t matrix)
+{
+    uint64_t rows = 0;
+    uint8_t columns_seen = 0;
+    uint8_t columns = 0;
+
+    // Without diodes a key can only be a ghost if it has another key down in its row and
+    // another key down in its column, closing a rectangle
+    for (int i = 0; i < 8; i++)
     {
-        keyboard_return.keyboard_scan_return = SCAN_RETURN_AWAITING_NO_ACTIVITY;
-        return keyboard_return;
+        uint8_t row = keyboard_matrix_row(matrix, i);
+
+        if (row & (row - 1))
+            rows |= (uint64_t) 0xFF << (8 * i);
+
+        columns |= columns_seen & row;
+        columns_seen |= row;
     }
 
-    // Scan keyboard matrix
-    uint8_t strobe = 0xFE;
-    ctx->pa_out_write(strobe);
-    ctx->scan_results[7] = ctx->pb_in_read();
+    return matrix & rows & (columns * 0x0101010101010101ULL);
+}
+
 
-    for (int i = 6; i > -1; i--)
+static KEYBOARD_RAMFUNC bool keyboard_scan_strobe_start(struct keyboard_ctx* ctx)
+{
+    if (ctx->scan_state != SCAN_STATE_IDLE)
+        return false;
+
+    if (ctx->incremental_scan)
     {
-        strobe = keyboard_rotate_left(strobe);
-        ctx->pa_out_write(strobe);
-        ctx->scan_results[i] = ctx->pb_in_read();
+        keyboard_scan_groups_start(ctx);
+        return true;
     }
 
-    // Initialize buffer, flags and max keys
-    memset(ctx->buffer_new, 0xFF, sizeof(ctx->buffer_new));
-    ctx->non_alpha_flag_y = 0;
+    // Connect all Keyboard rows
+    KEYBOARD_PA_OUT_WRITE(ctx, 0);
+    ctx->scan_state = SCAN_STATE_ACTIVITY_CHECK;
+    return true;
+}
 
-    ctx->key_quantity = MAX_KEY_ROLLOVER;
-    ctx->simultaneous_keys = 0xFE;
+static KEYBOARD_RAMFUNC void keyboard_scan_wait(struct keyboard_ctx* ctx)
+{
+    do
+    {
+        if (ctx->settle_wait)
+            ctx->settle_wait(keyboard_settle_row(ctx));
+    }
+    while (keyboard_scan_continue(ctx));
+}
 
-    // Check and flag non-alphanumeric keys
-    ctx->non_alpha_flag_y = ((ctx->scan_results[6] ^ 0xFF) & 0x80) >> 1; // Left SHIFT key
-    ctx->non_alpha_flag_y |= ((ctx->scan_results[0] ^ 0xFF) & 0xA4); // RUN STOP - C= - CTRL
-    ctx->non_alpha_flag_y |= ((ctx->scan_results[1] ^ 0xFF) & 0x18); // Right SHIFT - CLR HOME
+static KEYBOARD_RAMFUNC void keyboard_scan_groups_start(struct keyboard_ctx* ctx)
+{
+    uint8_t rows = 0;
 
-    ctx->non_alpha_flag_x = ctx->scan_results[7] ^ 0xFF;    // The rest
-    
-    // Check for pressed keys
-    for (int i = 7; i > -1; i--)
+    for (int row = 0; row < 8; row++)
     {
-        if (ctx->scan_results[i] != 0xFF)
-        {
-            keyboard_return.keyboard_scan_return = keyboard_key_in_row(ctx, (7 - i) * 8, ctx->scan_results[i]);
+        if (keyboard_matrix_row(ctx->raw, row))
+            rows |= 1 << row;
+    }
 
-            if (keyboard_return.keyboard_scan_return != SCAN_RETURN_SUCCESS)
-                return keyboard_return;
-        }
+    ctx->matrix_scan = 0;
+    ctx->scan_group_count = 0;
+    ctx->scan_state = SCAN_STATE_GROUP;
+
+    // Rows without keys down last scan are read together, last
+    if (rows != 0xFF)
+        keyboard_scan_group_push(ctx, ~rows, 0);
+
+    for (int row = 7; row >= 0; row--)
+    {
+        if (rows & (1 << row))
+            keyboard_scan_group_push(ctx, 1 << row, 0);
     }
 
-    // Key scan completed
-    for (int i = MAX_KEY_ROLLOVER - 1; i > -1; i--)
+    keyboard_scan_groups_next(ctx);
+}
+
+// Resolves groups until one has to be read, strobes it and returns true, or returns false when
+// the matrix is complete
+static KEYBOARD_RAMFUNC bool keyboard_scan_groups_next(struct keyboard_ctx* ctx)
+{
+    while (ctx->scan_group_count)
     {
-        if (ctx->buffer_new[i] != 0xFF)
+        struct keyboard_scan_group group = ctx->scan_groups[ctx->scan_group_count - 1];
+        uint8_t rest = group.rows;
+        uint8_t half = 0;
+
+        if (!group.known)
         {
-            bool exist = false;
+            KEYBOARD_PA_OUT_WRITE(ctx, ~group.rows);
+            return true;
+        }
 
-            for (int j = 0; j < MAX_KEY_ROLLOVER; j++)
-            {
-                if (ctx->buffer_new[i] == ctx->buffer_old[j])
-                {
-                    exist = true;
-                    break;
-                }
-            }
+        ctx->scan_group_count--;
 
-            if (!exist)
+        if (group.cols == 0)
+        {
+            // The other half of an active group holds all of its columns
+            if (group.sibling_cols)
             {
-                ctx->buffer_quantity++;
-                ctx->buffer[ctx->buffer_quantity] = ctx->buffer_new[i];
-                ctx->simultaneous_keys++;
-
-                if (ctx->simultaneous_keys == 0)
-                {
-                    ctx->buffer_quantity = -1;
-                    ctx->simultaneous_alphanumeric_keys_flag = true;
-                    keyboard_return.keyboard_scan_return = SCAN_RETURN_MULTIPLE_KEYS_WITHIN_ONE_SCAN;
-                    return keyboard_return;
-                }
+                ctx->scan_groups[ctx->scan_group_count - 1].cols = group.sibling_cols;
+                ctx->scan_groups[ctx->scan_group_count - 1].known = true;
             }
+            continue;
         }
+
+        if ((group.rows & (group.rows - 1)) == 0)
+        {
+            ctx->matrix_scan |= (uint64_t) group.cols << (8 * __builtin_ctz(group.rows));
+            continue;
+        }
+
+        // Split into the lower and upper half of the rows
+        for (int n = __builtin_popcount(group.rows) / 2; n > 0; n--)
+        {
+            half |= rest & -rest;
+            rest &= rest - 1;
+        }
+
+        keyboard_scan_group_push(ctx, rest, 0);
+        keyboard_scan_group_push(ctx, half, group.cols);
     }
 
-    if (ctx->buffer_quantity >= 0)
+    return false;
+}
+
+static KEYBOARD_RAMFUNC void keyboard_scan_group_push(struct keyboard_ctx* ctx, uint8_t rows, uint8_t sibling_cols)
+{
+    ctx->scan_groups[ctx->scan_group_count++] = (struct keyboard_scan_group) {rows, 0, sibling_cols, false};
+}
+
+static KEYBOARD_RAMFUNC int keyboard_settle_row(const struct keyboard_ctx* ctx)
+{
+    uint8_t rows;
+
+    switch (ctx->scan_state)
+    {
+        case SCAN_STATE_ROW:
+            return ctx->scan_row;
+
+        case SCAN_STATE_GROUP:
+            rows = ctx->scan_groups[ctx->scan_group_count - 1].rows;
+            return (rows & (rows - 1)) == 0 ? __builtin_ctz(rows) : KEYBOARD_SETTLE_ALL_ROWS;
+
+        default:
+            return KEYBOARD_SETTLE_ALL_ROWS;
+    }
+}
+
+static KEYBOARD_RAMFUNC bool keyboard_scan_forward_done(struct keyboard_ctx* ctx)
+{
+    ctx->confirmed = 0;
+
+    if (!ctx->pb_out_write || !keyboard_ghost_mask(ctx->matrix_scan))
     {
-        ctx->buffer_quantity--;
-        keyboard_return.alpha_num = ctx->buffer[0];
-        memmove(ctx->buffer, ctx->buffer + 1, sizeof(ctx->buffer) - 1);
+        keyboard_scan_done(ctx, ctx->matrix_scan);
+        return false;
+    }
+
+    // Swap the port directions and strobe the columns
+    KEYBOARD_PA_OUT_WRITE(ctx, 0xFF);
+    ctx->pa_cfg_input_pull_high();
+    ctx->pb_out_write(0xFF);
+    ctx->pb_cfg_output();
+
+    ctx->scan_row = 0;
+    ctx->matrix_reverse = 0;
+    ctx->pb_out_write(0xFE);
+    ctx->scan_state = SCAN_STATE_REVERSE;
+    return true;
+}
+
+static KEYBOARD_RAMFUNC void keyboard_scan_reverse_done(struct keyboard_ctx* ctx)
+{
+    uint64_t ghosts = keyboard_ghost_mask(ctx->matrix_scan);
+    uint64_t disputed = ghosts & (ctx->matrix_scan ^ ctx->matrix_reverse);
+
+    ctx->pb_cfg_input_pull_high();
+    ctx->pa_cfg_output();
+
+    // Matching views leave the rectangle ambiguous
+    ctx->confirmed = disputed ? ghosts & ~disputed : 0;
+    keyboard_scan_done(ctx, ctx->matrix_scan & ~disputed);
+}
+
+static KEYBOARD_RAMFUNC void keyboard_scan_done(struct keyboard_ctx* ctx, uint64_t raw)
+{
+    ctx->raw = raw;
+    ctx->extra = ctx->extra_in_read ? ctx->extra_in_read() : 0;
+
+    if (ctx->profile->extra_rows)
+        ctx->raw_extra_rows = keyboard_scan_extra_rows(ctx);
+
+    // A raw scan stops before debouncing and decoding
+    if (ctx->raw_only)
+    {
+        ctx->scan_state = SCAN_STATE_IDLE;
+        return;
+    }
+
+    keyboard_evaluate_extra(ctx);
+
+    if (ctx->profile->extra_rows)
+        keyboard_evaluate_extra_rows(ctx);
+
+    uint64_t matrix = keyboard_debounce(&ctx->debounce, raw);
+    struct keyboard_return keyboard_return = {SCAN_RETURN_NO_ACTIVITY};
+
+    // Check for port activity, keys still queued are returned first
+    if (matrix == 0 && !ctx->pending_count)
+    {
+        ctx->pressed = 0;
+        ctx->released = ctx->matrix;
+        ctx->matrix = 0;
+        keyboard_post_events(ctx, 0, 0);
+    }
+    else
+    {
+        keyboard_return = keyboard_evaluate(ctx, matrix);
+    }
+
+    for (int row = 0; row < 8; row++)
+        ctx->row_time_prev[row] = ctx->row_time[row];
+
+    keyboard_scan_finish(ctx, keyboard_return);
+}
+
+static KEYBOARD_RAMFUNC uint32_t keyboard_scan_extra_rows(struct keyboard_ctx* ctx)
+{
+    uint32_t rows = 0;
+
+    if (!ctx->extra_row_read)
+        return 0;
+
+    for (int row = 0; row < ctx->profile->extra_rows; row++)
+        rows |= (uint32_t) (ctx->extra_row_read(row) ^ 0xFF) << (8 * row);
+
+    return rows;
+}
+
+static KEYBOARD_RAMFUNC void keyboard_evaluate_extra(struct keyboard_ctx* ctx)
+{
+    uint8_t latched = __atomic_exchange_n(&ctx->extra_latched, 0, __ATOMIC_ACQUIRE);
+    uint8_t changed = ctx->extra_state ^ ctx->extra;
+
+    // Latched lines already back up went down and up between the scans
+    uint8_t taps = latched & ~ctx->extra & ~ctx->extra_state;
+
+    ctx->extra_state = ctx->extra;
+
+    if (!ctx->events || !(changed | taps))
+        return;
+
+    uint32_t timestamp = ctx->timestamp ? ctx->timestamp() : 0;
+
+    keyboard_post_keys(ctx, changed & ~ctx->extra, false, timestamp, KEYBOARD_EXTRA_KEY);
+    keyboard_post_keys(ctx, changed & ctx->extra, true, timestamp, KEYBOARD_EXTRA_KEY);
+    keyboard_post_keys(ctx, taps, true, timestamp, KEYBOARD_EXTRA_KEY);
+    keyboard_post_keys(ctx, taps, false, timestamp, KEYBOARD_EXTRA_KEY);
+}
+
+static KEYBOARD_RAMFUNC void keyboard_evaluate_extra_rows(struct keyboard_ctx* ctx)
+{
+    uint32_t matrix = (uint32_t) keyboard_debounce(&ctx->debounce_extra_rows, ctx->raw_extra_rows);
+    uint32_t changed = ctx->matrix_extra_rows ^ matrix;
+
+    ctx->matrix_extra_rows = matrix;
+
+    if (!ctx->events || !changed)
+        return;
+
+    uint32_t timestamp = ctx->timestamp ? ctx->timestamp() : 0;
+
+    keyboard_post_keys(ctx, changed & ~matrix, false, timestamp, KEYBOARD_PROFILE_EXTRA_KEY);
+    keyboard_post_keys(ctx, changed & matrix, true, timestamp, KEYBOARD_PROFILE_EXTRA_KEY);
+}
+
+static KEYBOARD_RAMFUNC struct keyboard_return keyboard_evaluate(struct keyboard_ctx* ctx, uint64_t matrix)
+{
+    struct keyboard_return keyboard_return = {0};
+
+    // Keys that may be ghosts can not be pressed, only held or released
+    ctx->ghosts = keyboard_ghost_mask(matrix) & ~ctx->confirmed;
+    matrix &= ~ctx->ghosts | ctx->matrix;
+
+    uint64_t changed = ctx->matrix ^ matrix;
+    uint8_t order[64];
+    int count;
+
+    ctx->pressed = changed & matrix;
+    ctx->released = changed & ctx->matrix;
+    ctx->matrix = matrix;
+
+    count = keyboard_press_order(ctx, ctx->pressed, order);
+    keyboard_post_events(ctx, order, count);
+
+    // Check and flag non-alphanumeric keys
+    ctx->non_alpha_flag_y = keyboard_profile_flag_y(ctx->profile, matrix);
+    ctx->non_alpha_flag_x = keyboard_profile_flag_x(ctx->profile, matrix);
+
+    // New alphanumeric keys are queued in the order they went down and returned one per scan
+    for (int i = 0; i < count; i++)
+    {
+        if (!((ctx->alpha_mask >> order[i]) & 1))
+            continue;
+
+        if (ctx->pending_count < KEYBOARD_PENDING_KEYS)
+            ctx->pending[ctx->pending_count++] = order[i];
+        else
+            ctx->pending_drops++;
+    }
+
+    if (ctx->pending_count)
+    {
+        keyboard_return.alpha_num = keyboard_profile_key_code(ctx->profile, ctx->pending[0]);
+        ctx->pending_count--;
+
+        for (int i = 0; i < ctx->pending_count; i++)
+            ctx->pending[i] = ctx->pending[i + 1];
     }
     else
     {
         keyboard_return.alpha_num = 0xFF;
     }
 
-    memcpy(ctx->buffer_old, ctx->buffer_new, MAX_KEY_ROLLOVER);
     keyboard_return.non_alpha_flag_x = ctx->non_alpha_flag_x;
     keyboard_return.non_alpha_flag_y = ctx->non_alpha_flag_y;
     keyboard_return.keyboard_scan_return = SCAN_RETURN_SUCCESS;
     return keyboard_return;
 }
 
+static KEYBOARD_RAMFUNC void keyboard_scan_finish(struct keyboard_ctx* ctx, struct keyboard_return keyboard_return)
+{
+    ctx->scan_state = SCAN_STATE_IDLE;
+    ctx->scan_return = keyboard_return;
+
+    if (ctx->scan_complete)
+        ctx->scan_complete(ctx->scan_return);
+}
 
-static enum keyboard_scan_return keyboard_key_in_row(struct keyboard_ctx* ctx, int index, uint32_t scan_result)
+static KEYBOARD_RAMFUNC void keyboard_row_time(struct keyboard_ctx* ctx, uint8_t rows)
 {
-    for (int i = 0; i < 8; i++)
+    if (!ctx->timestamp)
+        return;
+
+    uint32_t now = ctx->timestamp();
+
+    for (; rows; rows &= rows - 1)
+        ctx->row_time[__builtin_ctz(rows)] = now;
+}
+
+// Sorts keys by estimated press time into order, keys of one row keep matrix order
+static KEYBOARD_RAMFUNC int keyboard_press_order(const struct keyboard_ctx* ctx, uint64_t keys, uint8_t* order)
+{
+    int count = 0;
+
+    for (; keys; keys &= keys - 1)
     {
-        if ((scan_result & (1 << (7 - i))) == 0)
-        {
-            // KeyFound
-            if (ctx->key_quantity == 0)
-                return SCAN_RETURN_KEY_SHADOWING_DETECTED; 
+        uint8_t key = __builtin_ctzll(keys);
+        uint32_t estimate = keyboard_press_estimate(ctx, key / 8);
+        int i = count++;
 
-            ctx->key_quantity--;
-            ctx->buffer_new[ctx->key_quantity] = key_table[index];
+        while (i > 0 && keyboard_time_before(ctx, estimate, keyboard_press_estimate(ctx, order[i - 1] / 8)))
+        {
+            order[i] = order[i - 1];
+            i--;
         }
 
-        index++;
+        order[i] = key;
     }
 
-    return SCAN_RETURN_SUCCESS;
+    return count;
+}
+
+static KEYBOARD_RAMFUNC uint32_t keyboard_press_estimate(const struct keyboard_ctx* ctx, int row)
+{
+    uint32_t elapsed = (ctx->row_time[row] - ctx->row_time_prev[row]) & ctx->timestamp_mask;
+
+    return (ctx->row_time_prev[row] + elapsed / 2) & ctx->timestamp_mask;
+}
+
+// Timestamps wrap at timestamp_mask, a is before b if it is less than half the range behind
+static KEYBOARD_RAMFUNC bool keyboard_time_before(const struct keyboard_ctx* ctx, uint32_t a, uint32_t b)
+{
+    return ((a - b) & ctx->timestamp_mask) > (ctx->timestamp_mask >> 1);
+}
+
+static KEYBOARD_RAMFUNC void keyboard_post_events(struct keyboard_ctx* ctx, const uint8_t* order, int count)
+{
+    if (!ctx->events)
+        return;
+
+    // Releases first, so a key released and pressed again is never reported twice down
+    for (uint64_t keys = ctx->released; keys; keys &= keys - 1)
+    {
+        unsigned int key = __builtin_ctzll(keys);
+
+        keyboard_post_event(ctx, key, false, ctx->row_time[key / 8]);
+    }
+
+    for (int i = 0; i < count; i++)
+        keyboard_post_event(ctx, order[i], true, ctx->row_time[order[i] / 8]);
+}
+
+static KEYBOARD_RAMFUNC void keyboard_post_keys(struct keyboard_ctx* ctx, uint64_t keys, bool pressed, uint32_t timestamp, unsigned int base)
+{
+    for (; keys; keys &= keys - 1)
+        keyboard_post_event(ctx, base + __builtin_ctzll(keys), pressed, timestamp);
+}
+
+static KEYBOARD_RAMFUNC void keyboard_post_event(struct keyboard_ctx* ctx, unsigned int key, bool pressed, uint32_t timestamp)
+{
+    struct keyboard_event event =
+    {
+        .timestamp = timestamp,
+        .key = key,
+        .pressed = pressed,
+    };
+
+    keyboard_event_put(ctx->events, &event);
 }
 
-static uint8_t keyboard_rotate_left(uint8_t data)
+static KEYBOARD_RAMFUNC uint8_t keyboard_matrix_row(uint64_t matrix, int row)
 {
-    return ((data >> 7) & 0x01) | (data << 1);
+    return (uint8_t) (matrix >> (8 * row));
 }
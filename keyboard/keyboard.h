@@ -23,6 +23,11 @@
 #if !defined(KEYBOARD_H_)
 #define KEYBOARD_H_
 
+#include "keyboard_debounce.h"
+#include "keyboard_event.h"
+#include "keyboard_profile.h"
+#include "keyboard_settle.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -32,7 +37,13 @@ extern "C"
 {
 #endif
 
-#define MAX_KEY_ROLLOVER    3
+// New alphanumeric keys waiting to be returned in alpha_num
+#define KEYBOARD_PENDING_KEYS   8
+
+// Matrix snapshots are 64-bit with bit (8 * row + column) set while the key at PA row and
+// PB column is down.
+#define KEYBOARD_MATRIX_BIT(row, column)    ((uint64_t) 1 << (8 * (row) + (column)))
+
 enum keyboard_scan_return
 {
     SCAN_RETURN_SUCCESS,
@@ -41,15 +52,76 @@ enum keyboard_scan_return
     SCAN_RETURN_KEY_SHADOWING_DETECTED,
     SCAN_RETURN_MULTIPLE_KEYS_WITHIN_ONE_SCAN,
     SCAN_RETURN_AWAITING_NO_ACTIVITY,
+    SCAN_RETURN_SCAN_PENDING,           // A matrix_scan_start backend is scanning, see keyboard_scan()
     SCAN_RETURNS,
 };
 
+enum keyboard_scan_state
+{
+    SCAN_STATE_IDLE,
+    SCAN_STATE_ACTIVITY_CHECK,
+    SCAN_STATE_ROW,
+    SCAN_STATE_GROUP,
+    SCAN_STATE_REVERSE,
+    SCAN_STATE_MATRIX,
+};
+
+// Group of rows strobed together by the incremental scan, cols is the OR of their columns
+struct keyboard_scan_group
+{
+    uint8_t rows;
+    uint8_t cols;
+    uint8_t sibling_cols;       // Columns of the group below this one if this one reads empty
+    bool known;                 // Set once cols has been read or deduced
+};
+
+// Seeded with at most 8 groups, a split replaces one group with two
+#define KEYBOARD_SCAN_GROUPS    8
+
+// Lines outside the matrix, active high in keyboard_raw.extra. Evaluated scans post their
+// changes as event keys from KEYBOARD_EXTRA_KEY on.
+#define KEYBOARD_EXTRA_RESTORE      0x01
+#define KEYBOARD_EXTRA_SHIFT_LOCK   0x02
+#define KEYBOARD_EXTRA_KEY          (KEYBOARD_PROFILE_EXTRA_KEY + 8 * KEYBOARD_PROFILE_MAX_EXTRA_ROWS)
+
+// Electrical state of the keyboard, before debouncing and decoding
+struct keyboard_raw
+{
+    uint64_t matrix;
+    uint8_t extra;
+    uint32_t extra_rows;        // Rows of the profile beyond PA0-PA7
+};
+
+struct keyboard_return
+{
+    enum keyboard_scan_return keyboard_scan_return;
+    uint8_t alpha_num;
+    uint8_t non_alpha_flag_x;
+    uint8_t non_alpha_flag_y;
+};
+
 struct keyboard_init_data
 {
     void (*pa_cfg_output)(void);
     void (*pb_cfg_input_pull_high)(void);
-    void (*pa_out_write)(uint8_t value);
-    uint8_t (*pb_in_read)(void);
+    void (*pa_out_write)(uint8_t value);                                // Unused with KEYBOARD_HAL_STATIC
+    uint8_t (*pb_in_read)(void);                                        // Unused with KEYBOARD_HAL_STATIC
+    void (*settle_wait)(int row);                                       // Optional, row settle delay for keyboard_scan(), see keyboard_settle.h
+    void (*scan_complete)(struct keyboard_return keyboard_return);      // Optional, called when a scan has completed
+    bool (*matrix_scan_start)(void);                                    // Optional, hardware sequenced scan backend
+    enum keyboard_debounce_mode debounce_mode;
+    uint8_t debounce_scans;
+    struct keyboard_event_ring* events;                                 // Optional, receives press and release events
+    uint32_t (*timestamp)(void);                                        // Optional, timestamp of the events
+    uint32_t timestamp_mask;                                            // Optional, bits counted by timestamp before it wraps, all 32 if not set
+    bool incremental_scan;                                              // Strobe groups of rows, see keyboard_scan_start()
+    void (*pb_cfg_output)(void);                                        // Optional, all four enable the reverse scan
+    void (*pa_cfg_input_pull_high)(void);
+    void (*pb_out_write)(uint8_t value);
+    uint8_t (*pa_in_read)(void);
+    uint8_t (*extra_in_read)(void);                                     // Optional, KEYBOARD_EXTRA_ lines
+    const struct keyboard_profile* profile;                             // Optional, keyboard_profile_c64 if not set
+    uint8_t (*extra_row_read)(int row);                                 // Optional, strobes an extra row of the profile and reads PB
 };
 
 struct keyboard_ctx
@@ -58,30 +130,97 @@ struct keyboard_ctx
     void (*pb_cfg_input_pull_high)(void);
     void (*pa_out_write)(uint8_t value);
     uint8_t (*pb_in_read)(void);
-    uint8_t scan_results[8];
-    uint8_t buffer_new[MAX_KEY_ROLLOVER];
-    uint8_t buffer_old[MAX_KEY_ROLLOVER];
-    uint8_t buffer[4];
-    int buffer_quantity;
-    uint8_t key_quantity;
-    uint8_t non_alpha_flag_x;
-    uint8_t non_alpha_flag_y;
-    uint8_t simultaneous_keys;
-    bool simultaneous_alphanumeric_keys_flag;
-};
-
-struct keyboard_return
-{
-    enum keyboard_scan_return keyboard_scan_return;
-    uint8_t alpha_num;
+    void (*settle_wait)(int row);
+    void (*scan_complete)(struct keyboard_return keyboard_return);
+    bool (*matrix_scan_start)(void);
+    struct keyboard_event_ring* events;
+    uint32_t (*timestamp)(void);
+    uint32_t timestamp_mask;
+    enum keyboard_scan_state scan_state;
+    int scan_row;
+    bool incremental_scan;
+    void (*pb_cfg_output)(void);
+    void (*pa_cfg_input_pull_high)(void);
+    void (*pb_out_write)(uint8_t value);
+    uint8_t (*pa_in_read)(void);
+    uint8_t (*extra_in_read)(void);
+    const struct keyboard_profile* profile;
+    uint8_t (*extra_row_read)(int row);
+    bool raw_only;              // Scan stops at the raw matrix
+    int scan_group_count;
+    struct keyboard_scan_group scan_groups[KEYBOARD_SCAN_GROUPS];
+    struct keyboard_return scan_return;
+    struct keyboard_debounce_ctx debounce;
+    struct keyboard_debounce_ctx debounce_extra_rows;
+    uint64_t alpha_mask;        // Matrix positions with an alphanumeric key code
+    uint64_t matrix_scan;       // Matrix being scanned
+    uint64_t matrix_reverse;    // Matrix scanned with PB strobed and PA read
+    uint64_t confirmed;         // Keys of a ghost rectangle that the reverse scan has confirmed
+    uint64_t raw;               // Last scanned matrix before debouncing
+    uint8_t extra;              // Extra lines read with raw
+    uint8_t extra_latched;      // Extra lines seen active since the last evaluated scan
+    uint8_t extra_state;        // Last evaluated extra lines
+    uint32_t raw_extra_rows;    // Extra rows of the profile read with raw
+    uint64_t matrix;            // Last evaluated matrix
+    uint32_t matrix_extra_rows; // Last evaluated extra rows
+    uint64_t pressed;           // Keys pressed by the last evaluated scan
+    uint64_t released;          // Keys released by the last evaluated scan
+    uint8_t pending[KEYBOARD_PENDING_KEYS];     // Pressed alphanumeric keys not yet returned in alpha_num, oldest first
+    uint8_t pending_count;
+    uint32_t pending_drops;     // Pressed alphanumeric keys dropped because pending was full
+    uint32_t row_time[8];       // Time each row was last read, from timestamp
+    uint32_t row_time_prev[8];  // Row times of the previous evaluated scan
+    uint64_t ghosts;            // Keys of the last evaluated scan that may be ghosts
     uint8_t non_alpha_flag_x;
     uint8_t non_alpha_flag_y;
 };
 
 
+// The profile decodes the matrix, see keyboard_profile.h. Its extra rows are read after the
+// matrix through extra_row_read, debounced on their own and posted as events from
+// KEYBOARD_PROFILE_EXTRA_KEY on; a profile without extra rows adds nothing to the scan.
 void keyboard_init(struct keyboard_ctx* ctx, const struct keyboard_init_data* init);
+
+// Keys new in the same scan are ordered by when their rows were read. A key went down between
+// the last two reads of its row, and the midpoint of that window is taken as its press time.
+// Press events carry that order and the read time of their row, and alphanumeric keys are
+// queued for alpha_num in the same order.
+// A matrix_scan_start backend owns the port, so the rows cannot be strobed from here. Then
+// keyboard_scan() starts the hardware sequence unless it is running and returns
+// SCAN_RETURN_SCAN_PENDING, the result is passed to scan_complete.
 struct keyboard_return keyboard_scan(struct keyboard_ctx* ctx);
 
+// Raw layer, scans the matrix and reads the extra lines into raw without debouncing, decoding,
+// events or scan_complete. The matrix is still remembered as the last scan for the incremental
+// scan. Returns false without scanning if a matrix_scan_start backend owns the port.
+bool keyboard_scan_raw(struct keyboard_ctx* ctx, struct keyboard_raw* raw);
+
+// Split-phase scan. keyboard_scan_start() drives the first strobe and returns. Every time the
+// rows have settled keyboard_scan_continue() shall be called; it samples the columns, drives
+// the next strobe and returns true as long as another settle period is needed. When it
+// returns false the scan is complete and the result has been passed to scan_complete.
+// An incremental scan strobes the rows with keys down in the last scan one by one and all other
+// rows together, and splits any group reading active columns in halves until it is resolved.
+// With no keys down the first group is all rows, which makes it the activity check.
+// When the scanned matrix holds a ghost rectangle and the reverse port operations are set, the
+// columns are strobed and the rows read as well. Keys of the rectangle seen one way only are
+// dropped, and if that tells the views apart the keys seen both ways are accepted as real.
+bool keyboard_scan_start(struct keyboard_ctx* ctx);
+bool keyboard_scan_continue(struct keyboard_ctx* ctx);
+
+// With a matrix_scan_start backend keyboard_scan_start() only starts the hardware sequence, and
+// the backend completes the scan by passing the scanned matrix to keyboard_scan_matrix().
+void keyboard_scan_matrix(struct keyboard_ctx* ctx, uint64_t matrix);
+
+// Records extra lines seen active by an edge interrupt. The next evaluated scan reports them
+// pressed, and released again if they are already back up, so a momentary line such as
+// RESTORE is caught however slow the scan is. Safe to call from any interrupt priority.
+void keyboard_extra_latch(struct keyboard_ctx* ctx, uint8_t lines);
+
+// Returns the keys in matrix that share a row with one key down and a column with another, any
+// of which may be a ghost of the other three.
+uint64_t keyboard_ghost_mask(uint64_t matrix);
+
 #if defined(__cplusplus)
 }
 #endif
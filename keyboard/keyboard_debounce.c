@@ -0,0 +1,136 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_debounce.h"
+#include "keyboard_ramfunc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+static uint64_t keyboard_debounce_stable(struct keyboard_debounce_ctx* ctx, uint64_t changed);
+static uint64_t keyboard_debounce_integrate(struct keyboard_debounce_ctx* ctx, uint64_t raw);
+static void keyboard_debounce_count_up(struct keyboard_debounce_ctx* ctx, uint64_t mask);
+static void keyboard_debounce_count_down(struct keyboard_debounce_ctx* ctx, uint64_t mask);
+static uint64_t keyboard_debounce_count_equal(const struct keyboard_debounce_ctx* ctx, uint8_t value);
+
+
+void keyboard_debounce_init(struct keyboard_debounce_ctx* ctx, enum keyboard_debounce_mode mode, uint8_t scans)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->mode = mode;
+
+    if (scans < 1)
+        scans = 1;
+    else if (scans > KEYBOARD_DEBOUNCE_MAX_SCANS)
+        scans = KEYBOARD_DEBOUNCE_MAX_SCANS;
+
+    ctx->scans = scans;
+}
+
+KEYBOARD_RAMFUNC uint64_t keyboard_debounce(struct keyboard_debounce_ctx* ctx, uint64_t raw)
+{
+    switch (ctx->mode)
+    {
+        case DEBOUNCE_MODE_EAGER:
+            ctx->state |= raw;
+            ctx->state ^= keyboard_debounce_stable(ctx, ctx->state & ~raw);
+            break;
+
+        case DEBOUNCE_MODE_DEFER:
+            ctx->state ^= keyboard_debounce_stable(ctx, ctx->state ^ raw);
+            break;
+
+        case DEBOUNCE_MODE_INTEGRATOR:
+            ctx->state = keyboard_debounce_integrate(ctx, raw);
+            break;
+
+        default:
+            ctx->state = raw;
+            break;
+    }
+
+    return ctx->state;
+}
+
+
+// Counts consecutive scans of the keys in changed. Returns the keys that have been changed for
+// scans scans, their counters and the counters of unchanged keys start over.
+static KEYBOARD_RAMFUNC uint64_t keyboard_debounce_stable(struct keyboard_debounce_ctx* ctx, uint64_t changed)
+{
+    keyboard_debounce_count_up(ctx, changed);
+
+    uint64_t stable = changed & keyboard_debounce_count_equal(ctx, ctx->scans);
+
+    for (int i = 0; i < KEYBOARD_DEBOUNCE_COUNTER_BITS; i++)
+        ctx->count[i] &= changed & ~stable;
+
+    return stable;
+}
+
+static KEYBOARD_RAMFUNC uint64_t keyboard_debounce_integrate(struct keyboard_debounce_ctx* ctx, uint64_t raw)
+{
+    uint64_t top = keyboard_debounce_count_equal(ctx, ctx->scans);
+    uint64_t bottom = keyboard_debounce_count_equal(ctx, 0);
+
+    keyboard_debounce_count_up(ctx, raw & ~top);
+    keyboard_debounce_count_down(ctx, ~raw & ~bottom);
+
+    // Output only flips at the ends, in between the previous state is kept
+    return (ctx->state | keyboard_debounce_count_equal(ctx, ctx->scans))
+         & ~keyboard_debounce_count_equal(ctx, 0);
+}
+
+static KEYBOARD_RAMFUNC void keyboard_debounce_count_up(struct keyboard_debounce_ctx* ctx, uint64_t mask)
+{
+    uint64_t carry = mask;
+
+    for (int i = 0; i < KEYBOARD_DEBOUNCE_COUNTER_BITS; i++)
+    {
+        uint64_t next = ctx->count[i] & carry;
+        ctx->count[i] ^= carry;
+        carry = next;
+    }
+}
+
+static KEYBOARD_RAMFUNC void keyboard_debounce_count_down(struct keyboard_debounce_ctx* ctx, uint64_t mask)
+{
+    uint64_t borrow = mask;
+
+    for (int i = 0; i < KEYBOARD_DEBOUNCE_COUNTER_BITS; i++)
+    {
+        uint64_t next = ~ctx->count[i] & borrow;
+        ctx->count[i] ^= borrow;
+        borrow = next;
+    }
+}
+
+static KEYBOARD_RAMFUNC uint64_t keyboard_debounce_count_equal(const struct keyboard_debounce_ctx* ctx, uint8_t value)
+{
+    uint64_t equal = ~(uint64_t) 0;
+
+    for (int i = 0; i < KEYBOARD_DEBOUNCE_COUNTER_BITS; i++)
+        equal &= (value & (1 << i)) ? ctx->count[i] : ~ctx->count[i];
+
+    return equal;
+}
@@ -0,0 +1,63 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_DEBOUNCE_H_)
+#define KEYBOARD_DEBOUNCE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Per-key counters are bit-sliced, count[i] holds bit i of the counter of all 64 keys
+#define KEYBOARD_DEBOUNCE_COUNTER_BITS  3
+#define KEYBOARD_DEBOUNCE_MAX_SCANS     ((1 << KEYBOARD_DEBOUNCE_COUNTER_BITS) - 1)
+
+enum keyboard_debounce_mode
+{
+    DEBOUNCE_MODE_NONE,         // Raw matrix is passed through
+    DEBOUNCE_MODE_EAGER,        // Press is accepted at once, release after scans stable scans
+    DEBOUNCE_MODE_DEFER,        // Press and release are accepted after scans stable scans
+    DEBOUNCE_MODE_INTEGRATOR,   // Per-key counter moves towards the raw state, output flips at 0 and scans
+    DEBOUNCE_MODES,
+};
+
+struct keyboard_debounce_ctx
+{
+    enum keyboard_debounce_mode mode;
+    uint8_t scans;
+    uint64_t state;
+    uint64_t count[KEYBOARD_DEBOUNCE_COUNTER_BITS];
+};
+
+
+void keyboard_debounce_init(struct keyboard_debounce_ctx* ctx, enum keyboard_debounce_mode mode, uint8_t scans);
+uint64_t keyboard_debounce(struct keyboard_debounce_ctx* ctx, uint64_t raw);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_DEBOUNCE_H_)
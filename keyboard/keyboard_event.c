@@ -0,0 +1,75 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_event.h"
+#include "keyboard_ramfunc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#define KEYBOARD_EVENT_RING_MASK    (KEYBOARD_EVENT_RING_SIZE - 1)
+
+_Static_assert((KEYBOARD_EVENT_RING_SIZE & KEYBOARD_EVENT_RING_MASK) == 0, "Ring size must be a power of two");
+
+
+void keyboard_event_ring_init(struct keyboard_event_ring* ring)
+{
+    memset(ring, 0, sizeof(*ring));
+}
+
+KEYBOARD_RAMFUNC bool keyboard_event_put(struct keyboard_event_ring* ring, const struct keyboard_event* event)
+{
+    uint32_t head = ring->head;
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == KEYBOARD_EVENT_RING_SIZE)
+    {
+        ring->overflows++;
+        return false;
+    }
+
+    ring->events[head & KEYBOARD_EVENT_RING_MASK] = *event;
+
+    // Event is written before it is published
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+KEYBOARD_RAMFUNC bool keyboard_event_get(struct keyboard_event_ring* ring, struct keyboard_event* event)
+{
+    uint32_t tail = ring->tail;
+
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+        return false;
+
+    *event = ring->events[tail & KEYBOARD_EVENT_RING_MASK];
+
+    // Slot is read before it is handed back to the producer
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+KEYBOARD_RAMFUNC uint32_t keyboard_event_count(const struct keyboard_event_ring* ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
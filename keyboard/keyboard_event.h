@@ -0,0 +1,63 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_EVENT_H_)
+#define KEYBOARD_EVENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+#define KEYBOARD_EVENT_RING_SIZE    32      // Power of two
+
+struct keyboard_event
+{
+    uint32_t timestamp;
+    uint8_t key;                // Matrix position, 8 * row + column, see keyboard_profile.h for extra rows
+    bool pressed;
+};
+
+// Single producer, single consumer ring. The scan context puts and a lower priority context gets,
+// no locking is needed as head is only written by the producer and tail only by the consumer.
+struct keyboard_event_ring
+{
+    uint32_t head;
+    uint32_t tail;
+    uint32_t overflows;         // Events dropped because the ring was full
+    struct keyboard_event events[KEYBOARD_EVENT_RING_SIZE];
+};
+
+
+void keyboard_event_ring_init(struct keyboard_event_ring* ring);
+bool keyboard_event_put(struct keyboard_event_ring* ring, const struct keyboard_event* event);
+bool keyboard_event_get(struct keyboard_event_ring* ring, struct keyboard_event* event);
+uint32_t keyboard_event_count(const struct keyboard_event_ring* ring);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_EVENT_H_)
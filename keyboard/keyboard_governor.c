@@ -0,0 +1,87 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_governor.h"
+#include "keyboard_ramfunc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+static bool keyboard_governor_set(struct keyboard_governor_ctx* ctx, uint8_t tier);
+
+
+void keyboard_governor_init(struct keyboard_governor_ctx* ctx, const struct keyboard_governor_tier* tiers, uint8_t tier_count)
+{
+    ctx->tiers = tiers;
+    ctx->tier_count = tier_count;
+    ctx->tier = 0;
+    ctx->idle = 0;
+    ctx->raw = 0;
+}
+
+KEYBOARD_RAMFUNC bool keyboard_governor_update(struct keyboard_governor_ctx* ctx, uint64_t raw, uint32_t elapsed)
+{
+    const struct keyboard_governor_tier* tier = &ctx->tiers[ctx->tier];
+
+    if (raw != ctx->raw)
+    {
+        ctx->raw = raw;
+        return keyboard_governor_set(ctx, 0);
+    }
+
+    ctx->idle += elapsed;
+
+    if (ctx->tier + 1 >= ctx->tier_count || ctx->idle < tier->hold)
+        return false;
+
+    // Scanning is only parked with all keys up, a held key would wake it again at once
+    if (tier[1].interval == 0 && raw != 0)
+        return false;
+
+    return keyboard_governor_set(ctx, ctx->tier + 1);
+}
+
+KEYBOARD_RAMFUNC bool keyboard_governor_wake(struct keyboard_governor_ctx* ctx)
+{
+    return keyboard_governor_set(ctx, 0);
+}
+
+KEYBOARD_RAMFUNC uint32_t keyboard_governor_interval(const struct keyboard_governor_ctx* ctx)
+{
+    return ctx->tiers[ctx->tier].interval;
+}
+
+KEYBOARD_RAMFUNC bool keyboard_governor_parked(const struct keyboard_governor_ctx* ctx)
+{
+    return ctx->tiers[ctx->tier].interval == 0;
+}
+
+
+static KEYBOARD_RAMFUNC bool keyboard_governor_set(struct keyboard_governor_ctx* ctx, uint8_t tier)
+{
+    bool changed = ctx->tier != tier;
+
+    ctx->tier = tier;
+    ctx->idle = 0;
+    return changed;
+}
@@ -0,0 +1,67 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_GOVERNOR_H_)
+#define KEYBOARD_GOVERNOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Scan rate tiers, fastest first. Any change of the raw matrix moves straight to the first tier,
+// and a tier is only left for the next slower one after hold time without change, so a rate is
+// never left in the direction it was entered until the matrix has been stable for that long.
+struct keyboard_governor_tier
+{
+    uint32_t interval;          // Scan interval, 0 parks the scanning until keyboard_governor_wake()
+    uint32_t hold;              // Time without change before stepping down to the next tier
+};
+
+struct keyboard_governor_ctx
+{
+    const struct keyboard_governor_tier* tiers;
+    uint8_t tier_count;
+    uint8_t tier;
+    uint32_t idle;
+    uint64_t raw;
+};
+
+
+void keyboard_governor_init(struct keyboard_governor_ctx* ctx, const struct keyboard_governor_tier* tiers, uint8_t tier_count);
+
+// Called after every scan with the raw matrix and the time since the previous scan, which may
+// differ from the tier interval when the scans are paced by something else. Returns true when the
+// scan interval has changed.
+bool keyboard_governor_update(struct keyboard_governor_ctx* ctx, uint64_t raw, uint32_t elapsed);
+bool keyboard_governor_wake(struct keyboard_governor_ctx* ctx);
+uint32_t keyboard_governor_interval(const struct keyboard_governor_ctx* ctx);
+bool keyboard_governor_parked(const struct keyboard_governor_ctx* ctx);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_GOVERNOR_H_)
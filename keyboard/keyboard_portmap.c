@@ -0,0 +1,95 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_portmap.h"
+#include "keyboard_ramfunc.h"
+
+#include <stdint.h>
+
+#include "boards.h"
+
+
+#define REPEAT_4(m, a, b, v)    m(a, b, (v)) m(a, b, (v) + 1) m(a, b, (v) + 2) m(a, b, (v) + 3)
+#define REPEAT_16(m, a, b, v)   REPEAT_4(m, a, b, (v)) REPEAT_4(m, a, b, (v) + 4) REPEAT_4(m, a, b, (v) + 8) REPEAT_4(m, a, b, (v) + 12)
+#define REPEAT_64(m, a, b, v)   REPEAT_16(m, a, b, (v)) REPEAT_16(m, a, b, (v) + 16) REPEAT_16(m, a, b, (v) + 32) REPEAT_16(m, a, b, (v) + 48)
+#define REPEAT_256(m, a, b, v)  REPEAT_64(m, a, b, (v)) REPEAT_64(m, a, b, (v) + 64) REPEAT_64(m, a, b, (v) + 128) REPEAT_64(m, a, b, (v) + 192)
+
+// Port mask of a PA or PB pin when its bit is set in the nibble
+#define OUT_BIT(port, pin, nibble, bit) (((nibble) & (1 << (bit))) ? port##_PIN_MSK(pin) : 0)
+
+#define PA_LOW(port, nibble)  (OUT_BIT(port, PA0, nibble, 0) | OUT_BIT(port, PA1, nibble, 1) | OUT_BIT(port, PA2, nibble, 2) | OUT_BIT(port, PA3, nibble, 3))
+#define PA_HIGH(port, nibble) (OUT_BIT(port, PA4, nibble, 0) | OUT_BIT(port, PA5, nibble, 1) | OUT_BIT(port, PA6, nibble, 2) | OUT_BIT(port, PA7, nibble, 3))
+#define PB_LOW(port, nibble)  (OUT_BIT(port, PB0, nibble, 0) | OUT_BIT(port, PB1, nibble, 1) | OUT_BIT(port, PB2, nibble, 2) | OUT_BIT(port, PB3, nibble, 3))
+#define PB_HIGH(port, nibble) (OUT_BIT(port, PB4, nibble, 0) | OUT_BIT(port, PB5, nibble, 1) | OUT_BIT(port, PB6, nibble, 2) | OUT_BIT(port, PB7, nibble, 3))
+
+#define OUT_ENTRY(port, half, nibble)   half(port, nibble),
+
+// Bit of a PA or PB pin when it is set in the given byte of the port IN value
+#define IN_BIT(group, port, n, byte, in) \
+    ((((uint32_t) port##_PIN_MSK(group##n) >> (8 * (byte))) & (in)) ? (1 << (n)) : 0)
+
+#define IN_ENTRY(group, port, byte, in) \
+    (IN_BIT(group, port, 0, byte, in) | IN_BIT(group, port, 1, byte, in) | \
+     IN_BIT(group, port, 2, byte, in) | IN_BIT(group, port, 3, byte, in) | \
+     IN_BIT(group, port, 4, byte, in) | IN_BIT(group, port, 5, byte, in) | \
+     IN_BIT(group, port, 6, byte, in) | IN_BIT(group, port, 7, byte, in)),
+
+#define PA_IN_ENTRY(port, byte, in)     IN_ENTRY(PA, port, byte, in)
+#define PB_IN_ENTRY(port, byte, in)     IN_ENTRY(PB, port, byte, in)
+
+#define IN_TABLE(entry, port) \
+{ \
+    { REPEAT_256(entry, port, 0, 0) }, \
+    { REPEAT_256(entry, port, 1, 0) }, \
+    { REPEAT_256(entry, port, 2, 0) }, \
+    { REPEAT_256(entry, port, 3, 0) }, \
+}
+
+
+KEYBOARD_RAMDATA const uint32_t keyboard_portmap_pa_p0[2][16] =
+{
+    { REPEAT_16(OUT_ENTRY, P0, PA_LOW, 0) },
+    { REPEAT_16(OUT_ENTRY, P0, PA_HIGH, 0) },
+};
+
+KEYBOARD_RAMDATA const uint32_t keyboard_portmap_pa_p1[2][16] =
+{
+    { REPEAT_16(OUT_ENTRY, P1, PA_LOW, 0) },
+    { REPEAT_16(OUT_ENTRY, P1, PA_HIGH, 0) },
+};
+
+KEYBOARD_RAMDATA const uint32_t keyboard_portmap_pb_out_p0[2][16] =
+{
+    { REPEAT_16(OUT_ENTRY, P0, PB_LOW, 0) },
+    { REPEAT_16(OUT_ENTRY, P0, PB_HIGH, 0) },
+};
+
+KEYBOARD_RAMDATA const uint32_t keyboard_portmap_pb_out_p1[2][16] =
+{
+    { REPEAT_16(OUT_ENTRY, P1, PB_LOW, 0) },
+    { REPEAT_16(OUT_ENTRY, P1, PB_HIGH, 0) },
+};
+
+KEYBOARD_RAMDATA const uint8_t keyboard_portmap_pa_in_p0[4][256] = IN_TABLE(PA_IN_ENTRY, P0);
+KEYBOARD_RAMDATA const uint8_t keyboard_portmap_pa_in_p1[4][256] = IN_TABLE(PA_IN_ENTRY, P1);
+KEYBOARD_RAMDATA const uint8_t keyboard_portmap_pb_p0[4][256] = IN_TABLE(PB_IN_ENTRY, P0);
+KEYBOARD_RAMDATA const uint8_t keyboard_portmap_pb_p1[4][256] = IN_TABLE(PB_IN_ENTRY, P1);
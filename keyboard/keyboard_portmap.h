@@ -0,0 +1,66 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_PORTMAP_H_)
+#define KEYBOARD_PORTMAP_H_
+
+#include "keyboard_ramfunc.h"
+
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Lookup tables between the 8 bit PA/PB values and the nRF52 ports, built from the board pin
+// definitions at compile time. A PA value is split in nibbles, a port IN value in bytes.
+// Tables that are not referenced are dropped by the linker, from RAM as well with
+// KEYBOARD_RAMFUNC_ENABLED. The P1 tables are only referenced when the board has pins on P1.
+extern const uint32_t keyboard_portmap_pa_p0[2][16];    // P0 pins driven high for each PA nibble
+extern const uint32_t keyboard_portmap_pa_p1[2][16];    // P1 pins driven high for each PA nibble
+extern const uint32_t keyboard_portmap_pb_out_p0[2][16]; // P0 pins driven high for each PB nibble, reverse scan
+extern const uint32_t keyboard_portmap_pb_out_p1[2][16]; // P1 pins driven high for each PB nibble, reverse scan
+extern const uint8_t keyboard_portmap_pa_in_p0[4][256]; // PA bits read back for each byte of P0 IN
+extern const uint8_t keyboard_portmap_pa_in_p1[4][256]; // PA bits read back for each byte of P1 IN
+extern const uint8_t keyboard_portmap_pb_p0[4][256];    // PB bits set for each byte of P0 IN
+extern const uint8_t keyboard_portmap_pb_p1[4][256];    // PB bits set for each byte of P1 IN
+
+
+static inline KEYBOARD_RAMFUNC uint32_t keyboard_portmap_scatter(const uint32_t table[2][16], uint8_t value)
+{
+    return table[0][value & 0x0F] | table[1][value >> 4];
+}
+
+static inline KEYBOARD_RAMFUNC uint8_t keyboard_portmap_gather(const uint8_t table[4][256], uint32_t in)
+{
+    return table[0][in & 0xFF]
+         | table[1][(in >> 8) & 0xFF]
+         | table[2][(in >> 16) & 0xFF]
+         | table[3][in >> 24];
+}
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_PORTMAP_H_)
@@ -0,0 +1,212 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_profile.h"
+#include "keyboard_ramfunc.h"
+
+#include <stdint.h>
+
+
+static uint8_t keyboard_profile_row(uint64_t matrix, int row);
+
+
+static KEYBOARD_RAMDATA const uint8_t keyboard_profile_c64_table[] =
+{
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,  // CRSR DOWN, F5, F3, F1, F7, CRSR RIGHT, RETURN, INST DEL
+    0xff, 0x05, 0x13, 0x1a, 0x34, 0x01, 0x17, 0x33,  // LEFT SHIFT, "E", "S", "Z", "4", "A", "W", "3"
+    0x18, 0x14, 0x06, 0x03, 0x36, 0x04, 0x12, 0x35,  // "X", "T", "F", "C", "6", "D", "R", "5"
+    0x16, 0x15, 0x08, 0x02, 0x38, 0x07, 0x19, 0x37,  // "V", "U", "H", "B", "8", "G", "Y", "7"
+    0x0e, 0x0f, 0x0b, 0x0d, 0x30, 0x0a, 0x09, 0x39,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
+    0x2c, 0x00, 0x3a, 0x2e, 0x2d, 0x0c, 0x10, 0x2b,  // ",", "@", ":", ".", "-", "L", "P", "+"
+    0x2f, 0x1e, 0x3d, 0xff, 0xff, 0x3b, 0x2a, 0x1c,  // "/", "^", "=", RIGHT SHIFT, HOME, ";", "*", "£"
+    0xff, 0x11, 0xff, 0x20, 0x32, 0xff, 0x1f, 0x31,  // RUN STOP, "Q", "C=" (CMD), " " (SPC), "2", "CTRL", "<-", "1"
+};
+
+// C64 matrix, then the K0-K2 lines
+static KEYBOARD_RAMDATA const uint8_t keyboard_profile_c128_table[] =
+{
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,  // CRSR DOWN, F5, F3, F1, F7, CRSR RIGHT, RETURN, INST DEL
+    0xff, 0x05, 0x13, 0x1a, 0x34, 0x01, 0x17, 0x33,  // LEFT SHIFT, "E", "S", "Z", "4", "A", "W", "3"
+    0x18, 0x14, 0x06, 0x03, 0x36, 0x04, 0x12, 0x35,  // "X", "T", "F", "C", "6", "D", "R", "5"
+    0x16, 0x15, 0x08, 0x02, 0x38, 0x07, 0x19, 0x37,  // "V", "U", "H", "B", "8", "G", "Y", "7"
+    0x0e, 0x0f, 0x0b, 0x0d, 0x30, 0x0a, 0x09, 0x39,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
+    0x2c, 0x00, 0x3a, 0x2e, 0x2d, 0x0c, 0x10, 0x2b,  // ",", "@", ":", ".", "-", "L", "P", "+"
+    0x2f, 0x1e, 0x3d, 0xff, 0xff, 0x3b, 0x2a, 0x1c,  // "/", "^", "=", RIGHT SHIFT, HOME, ";", "*", "£"
+    0xff, 0x11, 0xff, 0x20, 0x32, 0xff, 0x1f, 0x31,  // RUN STOP, "Q", "C=" (CMD), " " (SPC), "2", "CTRL", "<-", "1"
+    0x31, 0x37, 0x34, 0x32, 0xff, 0x35, 0x38, 0xff,  // K0: Keypad "1", "7", "4", "2", TAB, "5", "8", HELP
+    0x33, 0x39, 0x36, 0xff, 0xff, 0x2d, 0x2b, 0xff,  // K1: Keypad "3", "9", "6", ENTER, LINE FEED, "-", "+", ESC
+    0xff, 0xff, 0xff, 0xff, 0xff, 0x2e, 0x30, 0xff,  // K2: NO SCROLL, RIGHT, LEFT, DOWN, UP, keypad ".", "0", ALT
+};
+
+static KEYBOARD_RAMDATA const uint8_t keyboard_profile_c16_table[] =
+{
+    0x00, 0xff, 0xff, 0xff, 0xff, 0x1c, 0xff, 0xff,  // "@", F3, F2, F1, HELP, "£", RETURN, INST DEL
+    0xff, 0x05, 0x13, 0x1a, 0x34, 0x01, 0x17, 0x33,  // SHIFT, "E", "S", "Z", "4", "A", "W", "3"
+    0x18, 0x14, 0x06, 0x03, 0x36, 0x04, 0x12, 0x35,  // "X", "T", "F", "C", "6", "D", "R", "5"
+    0x16, 0x15, 0x08, 0x02, 0x38, 0x07, 0x19, 0x37,  // "V", "U", "H", "B", "8", "G", "Y", "7"
+    0x0e, 0x0f, 0x0b, 0x0d, 0x30, 0x0a, 0x09, 0x39,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
+    0x2c, 0x2d, 0x3a, 0x2e, 0xff, 0x0c, 0x10, 0xff,  // ",", "-", ":", ".", CRSR UP, "L", "P", CRSR DOWN
+    0x2f, 0x2b, 0x3d, 0xff, 0xff, 0x3b, 0x2a, 0xff,  // "/", "+", "=", ESC, CRSR RIGHT, ";", "*", CRSR LEFT
+    0xff, 0x11, 0xff, 0x20, 0x32, 0xff, 0xff, 0x31,  // RUN STOP, "Q", "C=" (CMD), " " (SPC), "2", "CTRL", HOME, "1"
+};
+
+// HID usages by position, the C64 key at the place of a PC key takes its usage
+static KEYBOARD_RAMDATA const uint8_t keyboard_profile_c64_usages[] =
+{
+    0x51, 0x3e, 0x3c, 0x3a, 0x40, 0x4f, 0x28, 0x2a,  // CRSR DOWN, F5, F3, F1, F7, CRSR RIGHT, RETURN, INST DEL
+    0x00, 0x08, 0x16, 0x1d, 0x21, 0x04, 0x1a, 0x20,  // LEFT SHIFT, "E", "S", "Z", "4", "A", "W", "3"
+    0x1b, 0x17, 0x09, 0x06, 0x23, 0x07, 0x15, 0x22,  // "X", "T", "F", "C", "6", "D", "R", "5"
+    0x19, 0x18, 0x0b, 0x05, 0x25, 0x0a, 0x1c, 0x24,  // "V", "U", "H", "B", "8", "G", "Y", "7"
+    0x11, 0x12, 0x0e, 0x10, 0x27, 0x0d, 0x0c, 0x26,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
+    0x36, 0x2f, 0x33, 0x37, 0x2e, 0x0f, 0x13, 0x2d,  // ",", "@" ([), ":" (;), ".", "-" (=), "L", "P", "+" (-)
+    0x38, 0x31, 0x32, 0x00, 0x4a, 0x34, 0x30, 0x49,  // "/", "^" (\), "=" (#), RIGHT SHIFT, HOME, ";" ('), "*" (]), "£" (INSERT)
+    0x29, 0x14, 0x00, 0x2c, 0x1f, 0x00, 0x35, 0x1e,  // RUN STOP (ESC), "Q", "C=" (CMD), " " (SPC), "2", "CTRL", "<-" (`), "1"
+};
+
+// C64 matrix, then the K0-K2 lines. ALT is a modifier, HELP and LINE FEED have no usage within
+// the report map.
+static KEYBOARD_RAMDATA const uint8_t keyboard_profile_c128_usages[] =
+{
+    0x51, 0x3e, 0x3c, 0x3a, 0x40, 0x4f, 0x28, 0x2a,  // CRSR DOWN, F5, F3, F1, F7, CRSR RIGHT, RETURN, INST DEL
+    0x00, 0x08, 0x16, 0x1d, 0x21, 0x04, 0x1a, 0x20,  // LEFT SHIFT, "E", "S", "Z", "4", "A", "W", "3"
+    0x1b, 0x17, 0x09, 0x06, 0x23, 0x07, 0x15, 0x22,  // "X", "T", "F", "C", "6", "D", "R", "5"
+    0x19, 0x18, 0x0b, 0x05, 0x25, 0x0a, 0x1c, 0x24,  // "V", "U", "H", "B", "8", "G", "Y", "7"
+    0x11, 0x12, 0x0e, 0x10, 0x27, 0x0d, 0x0c, 0x26,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
+    0x36, 0x2f, 0x33, 0x37, 0x2e, 0x0f, 0x13, 0x2d,  // ",", "@" ([), ":" (;), ".", "-" (=), "L", "P", "+" (-)
+    0x38, 0x31, 0x32, 0x00, 0x4a, 0x34, 0x30, 0x49,  // "/", "^" (\), "=" (#), RIGHT SHIFT, HOME, ";" ('), "*" (]), "£" (INSERT)
+    0x29, 0x14, 0x00, 0x2c, 0x1f, 0x00, 0x35, 0x1e,  // RUN STOP (ESC), "Q", "C=" (CMD), " " (SPC), "2", "CTRL", "<-" (`), "1"
+    0x59, 0x5f, 0x5c, 0x5a, 0x2b, 0x5d, 0x60, 0x00,  // K0: Keypad "1", "7", "4", "2", TAB, "5", "8", HELP
+    0x5b, 0x61, 0x5e, 0x58, 0x00, 0x56, 0x57, 0x29,  // K1: Keypad "3", "9", "6", ENTER, LINE FEED, "-", "+", ESC
+    0x47, 0x4f, 0x50, 0x51, 0x52, 0x63, 0x62, 0xe6,  // K2: NO SCROLL, RIGHT, LEFT, DOWN, UP, keypad ".", "0", ALT (right ALT)
+};
+
+// ESC takes the PC ESC, RUN STOP moves to PAUSE
+static KEYBOARD_RAMDATA const uint8_t keyboard_profile_c16_usages[] =
+{
+    0x2f, 0x3c, 0x3b, 0x3a, 0x40, 0x49, 0x28, 0x2a,  // "@" ([), F3, F2, F1, HELP (F7), "£" (INSERT), RETURN, INST DEL
+    0x00, 0x08, 0x16, 0x1d, 0x21, 0x04, 0x1a, 0x20,  // SHIFT, "E", "S", "Z", "4", "A", "W", "3"
+    0x1b, 0x17, 0x09, 0x06, 0x23, 0x07, 0x15, 0x22,  // "X", "T", "F", "C", "6", "D", "R", "5"
+    0x19, 0x18, 0x0b, 0x05, 0x25, 0x0a, 0x1c, 0x24,  // "V", "U", "H", "B", "8", "G", "Y", "7"
+    0x11, 0x12, 0x0e, 0x10, 0x27, 0x0d, 0x0c, 0x26,  // "N", "O" (Oscar), "K", "M", "0" (Zero), "J", "I", "9"
+    0x36, 0x2d, 0x33, 0x37, 0x52, 0x0f, 0x13, 0x51,  // ",", "-", ":" (;), ".", CRSR UP, "L", "P", CRSR DOWN
+    0x38, 0x2e, 0x32, 0x29, 0x4f, 0x34, 0x30, 0x50,  // "/", "+" (=), "=" (#), ESC, CRSR RIGHT, ";" ('), "*" (]), CRSR LEFT
+    0x48, 0x14, 0x00, 0x2c, 0x1f, 0x00, 0x4a, 0x1e,  // RUN STOP (PAUSE), "Q", "C=" (CMD), " " (SPC), "2", "CTRL", HOME, "1"
+};
+
+static KEYBOARD_RAMDATA const struct keyboard_profile_flag keyboard_profile_c64_flags[] =
+{
+    {1, 0x80, 1},   // Left SHIFT key
+    {7, 0xA4, 0},   // RUN STOP - C= - CTRL
+    {6, 0x18, 0},   // Right SHIFT - CLR HOME
+};
+
+static KEYBOARD_RAMDATA const struct keyboard_profile_flag keyboard_profile_c16_flags[] =
+{
+    {1, 0x80, 1},   // SHIFT key
+    {7, 0xA4, 0},   // RUN STOP - C= - CTRL
+    {7, 0x02, -2},  // CLR HOME, where the C64 has it
+};
+
+KEYBOARD_RAMDATA const struct keyboard_profile keyboard_profile_c64 =
+{
+    .name = "C64",
+    .extra_rows = 0,
+    .key_table = keyboard_profile_c64_table,
+    .usage_table = keyboard_profile_c64_usages,
+    .flag_x_row = 0,
+    .flag_y_count = 3,
+    .flag_y = keyboard_profile_c64_flags,
+};
+
+KEYBOARD_RAMDATA const struct keyboard_profile keyboard_profile_c128 =
+{
+    .name = "C128",
+    .extra_rows = 3,
+    .key_table = keyboard_profile_c128_table,
+    .usage_table = keyboard_profile_c128_usages,
+    .flag_x_row = 0,
+    .flag_y_count = 3,
+    .flag_y = keyboard_profile_c64_flags,
+};
+
+// C16 and Plus/4, both SHIFT keys share one position and the cursor keys are in rows 5 and 6
+KEYBOARD_RAMDATA const struct keyboard_profile keyboard_profile_c16 =
+{
+    .name = "C16/Plus4",
+    .extra_rows = 0,
+    .key_table = keyboard_profile_c16_table,
+    .usage_table = keyboard_profile_c16_usages,
+    .flag_x_row = 0,
+    .flag_y_count = 3,
+    .flag_y = keyboard_profile_c16_flags,
+};
+
+
+KEYBOARD_RAMFUNC uint8_t keyboard_profile_key_code(const struct keyboard_profile* profile, unsigned int key)
+{
+    // Tables run from PB7 to PB0 within each row, hence the ^ 7
+    return profile->key_table[key ^ 7];
+}
+
+KEYBOARD_RAMFUNC uint8_t keyboard_profile_usage(const struct keyboard_profile* profile, unsigned int key)
+{
+    return profile->usage_table[key ^ 7];
+}
+
+KEYBOARD_RAMFUNC uint8_t keyboard_profile_flag_x(const struct keyboard_profile* profile, uint64_t matrix)
+{
+    return keyboard_profile_row(matrix, profile->flag_x_row);
+}
+
+KEYBOARD_RAMFUNC uint8_t keyboard_profile_flag_y(const struct keyboard_profile* profile, uint64_t matrix)
+{
+    uint8_t flag_y = 0;
+
+    for (int i = 0; i < profile->flag_y_count; i++)
+    {
+        const struct keyboard_profile_flag* flag = &profile->flag_y[i];
+        uint8_t bits = keyboard_profile_row(matrix, flag->row) & flag->mask;
+
+        flag_y |= flag->shift >= 0 ? bits >> flag->shift : bits << -flag->shift;
+    }
+
+    return flag_y;
+}
+
+uint64_t keyboard_profile_alpha_mask(const struct keyboard_profile* profile)
+{
+    uint64_t alpha_mask = 0;
+
+    for (int i = 0; i < 64; i++)
+    {
+        if (keyboard_profile_key_code(profile, i) != 0xFF)
+            alpha_mask |= (uint64_t) 1 << i;
+    }
+
+    return alpha_mask;
+}
+
+
+static KEYBOARD_RAMFUNC uint8_t keyboard_profile_row(uint64_t matrix, int row)
+{
+    return (uint8_t) (matrix >> (8 * row));
+}
@@ -0,0 +1,80 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_PROFILE_H_)
+#define KEYBOARD_PROFILE_H_
+
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Rows beyond PA0-PA7 are read into keyboard_raw.extra_rows, 8 bits per row, and reported as
+// event keys from KEYBOARD_PROFILE_EXTRA_KEY on
+#define KEYBOARD_PROFILE_MAX_EXTRA_ROWS     4
+#define KEYBOARD_PROFILE_EXTRA_KEY          64
+
+// Non-alpha flag bits taken from one matrix row, shifted right by shift (left if negative)
+struct keyboard_profile_flag
+{
+    uint8_t row;
+    uint8_t mask;
+    int8_t shift;
+};
+
+// Keyboard layout as wired to the PA rows and PB columns. The code table holds 8 codes per row,
+// PB7 first, extra rows following the matrix rows. 0xFF marks keys reported through the
+// non-alpha flags. The usage table has the same layout and holds the HID usage of the PC key at
+// the same place, 0 for keys reported as modifiers through the non-alpha flags or with no usage.
+struct keyboard_profile
+{
+    const char* name;
+    uint8_t extra_rows;                         // Rows strobed outside PA, the C128 K0-K2 lines
+    const uint8_t* key_table;
+    const uint8_t* usage_table;
+    uint8_t flag_x_row;                         // Row reported as non_alpha_flag_x
+    uint8_t flag_y_count;
+    const struct keyboard_profile_flag* flag_y;
+};
+
+extern const struct keyboard_profile keyboard_profile_c64;
+extern const struct keyboard_profile keyboard_profile_c128;
+extern const struct keyboard_profile keyboard_profile_c16;
+
+
+// Code and HID usage of key, a matrix bit or KEYBOARD_PROFILE_EXTRA_KEY plus an extra rows bit
+uint8_t keyboard_profile_key_code(const struct keyboard_profile* profile, unsigned int key);
+uint8_t keyboard_profile_usage(const struct keyboard_profile* profile, unsigned int key);
+uint8_t keyboard_profile_flag_x(const struct keyboard_profile* profile, uint64_t matrix);
+uint8_t keyboard_profile_flag_y(const struct keyboard_profile* profile, uint64_t matrix);
+
+// Matrix positions with an alphanumeric key code
+uint64_t keyboard_profile_alpha_mask(const struct keyboard_profile* profile);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_PROFILE_H_)
+
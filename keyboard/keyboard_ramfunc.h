@@ -0,0 +1,57 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_RAMFUNC_H_)
+#define KEYBOARD_RAMFUNC_H_
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Code and constant data of the scan path are placed in .ramfunc sections, which the linker script
+// puts in RAM right after .data, so the startup code copies them from flash along with .data. Once
+// the scan path is entered it runs without flash wait states, also while the flash is stalled by an
+// erase or write. Getting there does not: the interrupt is dispatched through the MBR and SoftDevice
+// vector tables and the app_timer interrupt handler, all in flash.
+// Every marker expands to a section of its own, so the linker drops unreferenced functions and
+// tables as it does with -ffunction-sections and -fdata-sections. The linker script adds the
+// app_timer calls, libgcc and newlib helpers the scan path makes, and at -O0 the out of line copies
+// of the nrf_gpio and nrf_rtc helpers. Debug logging and the error handler still run from flash;
+// make ramfunc_report lists every direct call that does. Without KEYBOARD_RAMFUNC_ENABLED both
+// markers are empty.
+#if defined(KEYBOARD_RAMFUNC_ENABLED)
+#define KEYBOARD_RAMFUNC    KEYBOARD_RAMSECTION(".ramfunc.text", __COUNTER__)
+#define KEYBOARD_RAMDATA    KEYBOARD_RAMSECTION(".ramfunc.data", __COUNTER__)
+#define KEYBOARD_RAMSECTION(name, n)    KEYBOARD_RAMSECTION_(name, n)
+#define KEYBOARD_RAMSECTION_(name, n)   __attribute__((section(name "." #n)))
+#else
+#define KEYBOARD_RAMFUNC
+#define KEYBOARD_RAMDATA
+#endif
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_RAMFUNC_H_)
+
@@ -0,0 +1,277 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_report.h"
+#include "keyboard_ramfunc.h"
+#include "keyboard.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// Bits of non_alpha_flag_y, the same for every profile
+#define KEYBOARD_REPORT_FLAG_Y_LEFT_SHIFT   0x40
+#define KEYBOARD_REPORT_FLAG_Y_CMD          0x20
+#define KEYBOARD_REPORT_FLAG_Y_RIGHT_SHIFT  0x10
+#define KEYBOARD_REPORT_FLAG_Y_CTRL         0x04
+
+#define KEYBOARD_REPORT_USAGE_RESTORE       0x4B    // PAGE UP
+#define KEYBOARD_REPORT_USAGE_MODIFIER      0xE0    // LEFT CTRL, first of the 8 modifier usages
+
+
+static bool keyboard_report_empty(const uint8_t* report, size_t size);
+static bool keyboard_report_keys_equal(const struct keyboard_report_keys* a, const struct keyboard_report_keys* b);
+static bool keyboard_report_keys_transient(const struct keyboard_report_keys* before, const struct keyboard_report_keys* state, const struct keyboard_report_keys* after);
+static void keyboard_report_queue(struct keyboard_report_ctx* ctx);
+static void keyboard_report_collapse(const struct keyboard_report_keys* before, struct keyboard_report_keys* state, const struct keyboard_report_keys* after);
+static uint8_t keyboard_report_modifiers(uint8_t flag_y);
+static int keyboard_report_add(uint8_t* report, uint8_t* nkro_report, int keys, uint8_t usage);
+
+
+void keyboard_report_init(struct keyboard_report_ctx* ctx, const struct keyboard_profile* profile)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->profile = profile;
+}
+
+KEYBOARD_RAMFUNC void keyboard_report_event(struct keyboard_report_ctx* ctx, const struct keyboard_event* event)
+{
+    if (event->key >= KEYBOARD_EXTRA_KEY)
+    {
+        uint8_t line = 1 << (event->key - KEYBOARD_EXTRA_KEY);
+
+        ctx->keys.extra = event->pressed ? ctx->keys.extra | line : ctx->keys.extra & ~line;
+    }
+    else if (event->key >= KEYBOARD_PROFILE_EXTRA_KEY)
+    {
+        uint32_t bit = (uint32_t) 1 << (event->key - KEYBOARD_PROFILE_EXTRA_KEY);
+
+        ctx->keys.extra_rows = event->pressed ? ctx->keys.extra_rows | bit : ctx->keys.extra_rows & ~bit;
+    }
+    else
+    {
+        uint64_t bit = (uint64_t) 1 << event->key;
+
+        ctx->keys.matrix = event->pressed ? ctx->keys.matrix | bit : ctx->keys.matrix & ~bit;
+    }
+
+    keyboard_report_queue(ctx);
+}
+
+KEYBOARD_RAMFUNC bool keyboard_report_pending(const struct keyboard_report_ctx* ctx)
+{
+    return ctx->queue_count != 0 || ctx->nkro != ctx->nkro_selected || ctx->boot != ctx->boot_selected;
+}
+
+KEYBOARD_RAMFUNC bool keyboard_report_build(struct keyboard_report_ctx* ctx)
+{
+    uint8_t report[KEYBOARD_REPORT_SIZE] = {0};
+    uint8_t nkro_report[KEYBOARD_REPORT_NKRO_SIZE] = {0};
+    struct keyboard_report_keys state;
+    bool changed;
+    int keys = 0;
+
+    // A switch releases the keys on the report sent so far, then builds them again for the other
+    if (ctx->nkro != ctx->nkro_selected || ctx->boot != ctx->boot_selected)
+    {
+        bool down = ctx->nkro ? !keyboard_report_empty(ctx->nkro_report, sizeof(ctx->nkro_report)) :
+                                !keyboard_report_empty(ctx->report, sizeof(ctx->report));
+
+        memset(ctx->report, 0, sizeof(ctx->report));
+        memset(ctx->nkro_report, 0, sizeof(ctx->nkro_report));
+
+        if (down)
+            return true;
+
+        ctx->nkro = ctx->nkro_selected;
+        ctx->boot = ctx->boot_selected;
+    }
+    else if (!ctx->queue_count)
+    {
+        return false;
+    }
+
+    if (ctx->queue_count)
+    {
+        state = ctx->queue[0];
+        ctx->queue_count--;
+        memmove(&ctx->queue[0], &ctx->queue[1], ctx->queue_count * sizeof(ctx->queue[0]));
+        ctx->reported = state;
+
+        // Keys held back by a collapse are reported once the queue has drained
+        if (!ctx->queue_count)
+            keyboard_report_queue(ctx);
+    }
+    else
+    {
+        state = ctx->reported;
+    }
+
+    report[0] = keyboard_report_modifiers(keyboard_profile_flag_y(ctx->profile, state.matrix));
+
+    if (state.extra & KEYBOARD_EXTRA_SHIFT_LOCK)
+        report[0] |= KEYBOARD_REPORT_LEFT_SHIFT;
+
+    if (state.extra & KEYBOARD_EXTRA_RESTORE)
+        keys = keyboard_report_add(report, nkro_report, keys, KEYBOARD_REPORT_USAGE_RESTORE);
+
+    // Only the keys down are visited
+    for (uint64_t matrix = state.matrix; matrix; matrix &= matrix - 1)
+        keys = keyboard_report_add(report, nkro_report, keys, keyboard_profile_usage(ctx->profile, __builtin_ctzll(matrix)));
+
+    for (uint32_t extra_rows = state.extra_rows; extra_rows; extra_rows &= extra_rows - 1)
+        keys = keyboard_report_add(report, nkro_report, keys, keyboard_profile_usage(ctx->profile, KEYBOARD_PROFILE_EXTRA_KEY + __builtin_ctz(extra_rows)));
+
+    if (keys > KEYBOARD_REPORT_KEYS)
+        memset(&report[2], KEYBOARD_REPORT_ERROR_ROLLOVER, KEYBOARD_REPORT_KEYS);
+
+    nkro_report[0] = report[0];
+
+    if (ctx->nkro)
+        changed = memcmp(nkro_report, ctx->nkro_report, sizeof(nkro_report)) != 0;
+    else
+        changed = memcmp(report, ctx->report, sizeof(report)) != 0;
+
+    memcpy(ctx->report, report, sizeof(report));
+    memcpy(ctx->nkro_report, nkro_report, sizeof(nkro_report));
+    return changed;
+}
+
+void keyboard_report_nkro(struct keyboard_report_ctx* ctx, bool nkro)
+{
+    ctx->nkro_selected = nkro;
+}
+
+void keyboard_report_boot(struct keyboard_report_ctx* ctx, bool boot)
+{
+    ctx->boot_selected = boot;
+}
+
+
+// Queues the keys down, see keyboard_report_event()
+static KEYBOARD_RAMFUNC void keyboard_report_queue(struct keyboard_report_ctx* ctx)
+{
+    const struct keyboard_report_keys* before;
+    struct keyboard_report_keys* last;
+
+    if (!ctx->queue_count)
+    {
+        if (keyboard_report_keys_equal(&ctx->keys, &ctx->reported))
+            return;
+
+        ctx->queue[ctx->queue_count++] = ctx->keys;
+    }
+    else
+    {
+        before = ctx->queue_count > 1 ? &ctx->queue[ctx->queue_count - 2] : &ctx->reported;
+        last = &ctx->queue[ctx->queue_count - 1];
+
+        if (!keyboard_report_keys_transient(before, last, &ctx->keys))
+        {
+            *last = ctx->keys;
+        }
+        else if (ctx->queue_count < KEYBOARD_REPORT_QUEUE)
+        {
+            ctx->queue[ctx->queue_count++] = ctx->keys;
+        }
+        else
+        {
+            keyboard_report_collapse(before, last, &ctx->keys);
+            ctx->stats.collapsed++;
+        }
+    }
+
+    ctx->stats.queued++;
+
+    if (ctx->queue_count > ctx->stats.queue_max)
+        ctx->stats.queue_max = ctx->queue_count;
+}
+
+// Moves state on to after, except that keys released between before and state stay released
+static KEYBOARD_RAMFUNC void keyboard_report_collapse(const struct keyboard_report_keys* before, struct keyboard_report_keys* state, const struct keyboard_report_keys* after)
+{
+    state->matrix = after->matrix & ~(before->matrix & ~state->matrix);
+    state->extra_rows = after->extra_rows & ~(before->extra_rows & ~state->extra_rows);
+    state->extra = after->extra & ~(before->extra & ~state->extra);
+}
+
+static KEYBOARD_RAMFUNC bool keyboard_report_keys_equal(const struct keyboard_report_keys* a, const struct keyboard_report_keys* b)
+{
+    return a->matrix == b->matrix && a->extra_rows == b->extra_rows && a->extra == b->extra;
+}
+
+static KEYBOARD_RAMFUNC bool keyboard_report_empty(const uint8_t* report, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (report[i])
+            return false;
+    }
+
+    return true;
+}
+
+// Returns true if a key differs between before and state and is back as it was in after
+static KEYBOARD_RAMFUNC bool keyboard_report_keys_transient(const struct keyboard_report_keys* before, const struct keyboard_report_keys* state, const struct keyboard_report_keys* after)
+{
+    return ((before->matrix ^ state->matrix) & ~(before->matrix ^ after->matrix)) ||
+           ((before->extra_rows ^ state->extra_rows) & ~(before->extra_rows ^ after->extra_rows)) ||
+           ((before->extra ^ state->extra) & ~(before->extra ^ after->extra));
+}
+
+static KEYBOARD_RAMFUNC uint8_t keyboard_report_modifiers(uint8_t flag_y)
+{
+    uint8_t modifiers = 0;
+
+    if (flag_y & KEYBOARD_REPORT_FLAG_Y_LEFT_SHIFT)
+        modifiers |= KEYBOARD_REPORT_LEFT_SHIFT;
+    if (flag_y & KEYBOARD_REPORT_FLAG_Y_RIGHT_SHIFT)
+        modifiers |= KEYBOARD_REPORT_RIGHT_SHIFT;
+    if (flag_y & KEYBOARD_REPORT_FLAG_Y_CTRL)
+        modifiers |= KEYBOARD_REPORT_LEFT_CTRL;
+    if (flag_y & KEYBOARD_REPORT_FLAG_Y_CMD)
+        modifiers |= KEYBOARD_REPORT_LEFT_ALT;
+
+    return modifiers;
+}
+
+// Returns the number of keys with a usage so far, which may exceed the slots of the report
+static KEYBOARD_RAMFUNC int keyboard_report_add(uint8_t* report, uint8_t* nkro_report, int keys, uint8_t usage)
+{
+    if (usage >= KEYBOARD_REPORT_USAGE_MODIFIER)
+    {
+        report[0] |= 1 << (usage - KEYBOARD_REPORT_USAGE_MODIFIER);
+        return keys;
+    }
+
+    if (!usage)
+        return keys;
+
+    if (usage < KEYBOARD_REPORT_NKRO_USAGES)
+        nkro_report[1 + usage / 8] |= 1 << (usage % 8);
+
+    if (keys < KEYBOARD_REPORT_KEYS)
+        report[2 + keys] = usage;
+
+    return keys + 1;
+}
@@ -0,0 +1,124 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_REPORT_H_)
+#define KEYBOARD_REPORT_H_
+
+#include "keyboard_event.h"
+#include "keyboard_profile.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Boot keyboard layout, modifier bits, a reserved byte and up to 6 key usages
+#define KEYBOARD_REPORT_SIZE        8
+#define KEYBOARD_REPORT_KEYS        6
+
+// N-key rollover layout, the modifier bits followed by one bit per usage from 0 up to
+// KEYBOARD_REPORT_NKRO_USAGES
+#define KEYBOARD_REPORT_NKRO_USAGES 104
+#define KEYBOARD_REPORT_NKRO_SIZE   (1 + KEYBOARD_REPORT_NKRO_USAGES / 8)
+
+// HID modifier bits, byte 0 of both reports
+#define KEYBOARD_REPORT_LEFT_CTRL   0x01
+#define KEYBOARD_REPORT_LEFT_SHIFT  0x02
+#define KEYBOARD_REPORT_LEFT_ALT    0x04
+#define KEYBOARD_REPORT_RIGHT_SHIFT 0x20
+
+// Usage filling all key slots while more keys are down than fit
+#define KEYBOARD_REPORT_ERROR_ROLLOVER  0x01
+
+// Key states waiting to be reported, the required ones and the latest
+#define KEYBOARD_REPORT_QUEUE       8
+
+struct keyboard_report_keys
+{
+    uint64_t matrix;
+    uint32_t extra_rows;
+    uint8_t extra;              // KEYBOARD_EXTRA_ lines
+};
+
+struct keyboard_report_stats
+{
+    uint32_t queued;            // Key states queued, including those replacing the last one
+    uint32_t collapsed;         // Key states collapsed into the last one as the queue was full
+    uint32_t retries;           // Reports sent again, counted by the sender
+    uint8_t queue_max;          // Deepest the queue has been
+};
+
+// Keys down, kept from the press and release events of the scan, the states still to report and
+// the last built reports
+struct keyboard_report_ctx
+{
+    const struct keyboard_profile* profile;
+    struct keyboard_report_keys keys;
+    struct keyboard_report_keys queue[KEYBOARD_REPORT_QUEUE];  // Oldest first
+    uint8_t queue_count;
+    struct keyboard_report_keys reported;                       // State of the last built reports
+    bool nkro;                  // The N-key rollover report is the one sent
+    bool nkro_selected;         // Set by keyboard_report_nkro(), nkro follows once the keys are released on the old report
+    bool boot;                  // The 6-key report is sent as the boot protocol report
+    bool boot_selected;         // Set by keyboard_report_boot(), boot follows like nkro
+    uint8_t report[KEYBOARD_REPORT_SIZE];
+    uint8_t nkro_report[KEYBOARD_REPORT_NKRO_SIZE];
+    struct keyboard_report_stats stats;
+};
+
+
+void keyboard_report_init(struct keyboard_report_ctx* ctx, const struct keyboard_profile* profile);
+
+// Applies event to the keys down and queues the new state. The last state queued is replaced by
+// the new one unless a key changed on its way from the state before and changes back in the new
+// one, then it is kept so that a press and release between two reports are both seen. A full
+// queue collapses the new state into the last one but keeps the keys released on the way there
+// released, so no release is ever lost; keys held back by that are queued again once the queue
+// has drained.
+void keyboard_report_event(struct keyboard_report_ctx* ctx, const struct keyboard_event* event);
+
+// Returns true while states are queued or a switch of report or protocol is to be sent
+bool keyboard_report_pending(const struct keyboard_report_ctx* ctx);
+
+// Builds both reports from the oldest queued state into report and nkro_report, returns true if
+// the one sent differs from the last one. The profile maps keys to usages and SHIFT, CTRL and C=
+// to modifiers through the non-alpha flags, SHIFT LOCK holds left SHIFT like on the C64 and
+// RESTORE is PAGE UP. Usages are set at their own bit of nkro_report, so keys never move within it.
+bool keyboard_report_build(struct keyboard_report_ctx* ctx);
+
+// Selects the N-key rollover report, for hosts that have subscribed to it. The switch is made by
+// keyboard_report_build(): first an empty report on the old one if keys are down, so the host
+// sees them released there, then the keys down on the new one.
+void keyboard_report_nkro(struct keyboard_report_ctx* ctx, bool nkro);
+
+// Selects the boot protocol report, switched like keyboard_report_nkro(). A switch of protocol and
+// report at once releases the keys on the report sent before either.
+void keyboard_report_boot(struct keyboard_report_ctx* ctx, bool boot);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_REPORT_H_)
@@ -0,0 +1,129 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "keyboard_settle.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+static bool keyboard_settle_row(const struct keyboard_settle_init_data* init, uint8_t pa, uint16_t* settle_us);
+static bool keyboard_settle_probe(const struct keyboard_settle_init_data* init, uint8_t pa, uint16_t delay_us, uint8_t expected);
+
+
+bool keyboard_settle_calibrate(struct keyboard_settle_ctx* ctx, const struct keyboard_settle_init_data* init)
+{
+    bool calibrated = true;
+
+    for (int row = 0; row < KEYBOARD_SETTLE_ROWS; row++)
+    {
+        uint8_t pa = row == KEYBOARD_SETTLE_ALL_ROWS ? 0x00 : ~(1 << row);
+
+        if (!keyboard_settle_row(init, pa, &ctx->settle_us[row]))
+        {
+            ctx->settle_us[row] = init->max_us;
+            calibrated = false;
+        }
+    }
+
+    return calibrated;
+}
+
+void keyboard_settle_default(struct keyboard_settle_ctx* ctx, uint16_t settle_us)
+{
+    for (int row = 0; row < KEYBOARD_SETTLE_ROWS; row++)
+        ctx->settle_us[row] = settle_us;
+}
+
+uint16_t keyboard_settle_max_us(const struct keyboard_settle_ctx* ctx)
+{
+    uint16_t max_us = 0;
+
+    for (int row = 0; row < KEYBOARD_SETTLE_ROWS; row++)
+    {
+        if (ctx->settle_us[row] > max_us)
+            max_us = ctx->settle_us[row];
+    }
+
+    return max_us;
+}
+
+uint16_t keyboard_settle_total_us(const struct keyboard_settle_ctx* ctx)
+{
+    uint16_t total_us = 0;
+
+    for (int row = 0; row < KEYBOARD_SETTLE_ROWS; row++)
+        total_us += ctx->settle_us[row];
+
+    return total_us;
+}
+
+uint32_t keyboard_settle_pass_us(const struct keyboard_settle_ctx* ctx, uint16_t period_us)
+{
+    uint32_t pass_us = 0;
+
+    for (int row = 0; row < KEYBOARD_SETTLE_ROWS; row++)
+        pass_us += ctx->settle_us[row] > period_us ? ctx->settle_us[row] : period_us;
+
+    return pass_us;
+}
+
+
+static bool keyboard_settle_row(const struct keyboard_settle_init_data* init, uint8_t pa, uint16_t* settle_us)
+{
+    // Columns read after the longest delay are the settled value, a key changing
+    // during calibration shows up as a mismatch and the row is not calibrated
+    uint8_t settled = init->probe(pa, init->max_us);
+    uint16_t safe_us = init->max_us;
+
+    if (!keyboard_settle_probe(init, pa, init->max_us, settled))
+        return false;
+
+    for (uint16_t delay_us = init->max_us; delay_us >= init->step_us; )
+    {
+        delay_us -= init->step_us;
+
+        if (!keyboard_settle_probe(init, pa, delay_us, settled))
+            break;
+
+        safe_us = delay_us;
+    }
+
+    // Confirm the settled value has not changed while probing
+    if (!keyboard_settle_probe(init, pa, init->max_us, settled))
+        return false;
+
+    safe_us += safe_us / 2 + init->margin_us;
+    *settle_us = safe_us < init->max_us ? safe_us : init->max_us;
+    return true;
+}
+
+static bool keyboard_settle_probe(const struct keyboard_settle_init_data* init, uint8_t pa, uint16_t delay_us, uint8_t expected)
+{
+    for (int i = 0; i < init->repeats; i++)
+    {
+        if (init->probe(pa, delay_us) != expected)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,67 @@
+// MIT License
+// 
+// Copyright © 2023 Greg Lund
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#if !defined(KEYBOARD_SETTLE_H_)
+#define KEYBOARD_SETTLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+// Rows 0 to 7 are strobed alone, the activity check strobes all rows at once
+#define KEYBOARD_SETTLE_ALL_ROWS    8
+#define KEYBOARD_SETTLE_ROWS        9
+
+struct keyboard_settle_init_data
+{
+    // Discharges the columns, strobes pa, waits delay_us after releasing the columns and returns PB
+    uint8_t (*probe)(uint8_t pa, uint16_t delay_us);
+    uint16_t max_us;            // Settle time known to be safe, also used for rows that fail calibration
+    uint16_t step_us;           // Delay decrement between probes
+    uint8_t repeats;            // Probes that must all match at a delay for it to be safe
+    uint16_t margin_us;         // Added to half again the shortest safe delay
+};
+
+struct keyboard_settle_ctx
+{
+    uint16_t settle_us[KEYBOARD_SETTLE_ROWS];
+};
+
+
+// Returns false if any row read unstable at max_us, those rows keep max_us
+bool keyboard_settle_calibrate(struct keyboard_settle_ctx* ctx, const struct keyboard_settle_init_data* init);
+void keyboard_settle_default(struct keyboard_settle_ctx* ctx, uint16_t settle_us);
+uint16_t keyboard_settle_max_us(const struct keyboard_settle_ctx* ctx);
+uint16_t keyboard_settle_total_us(const struct keyboard_settle_ctx* ctx);
+// Duration of a full pass, the activity check and all 8 rows, when no read comes sooner than
+// period_us after its strobe. 0 is a pass that waits the settle times inline.
+uint32_t keyboard_settle_pass_us(const struct keyboard_settle_ctx* ctx, uint16_t period_us);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif // !defined(KEYBOARD_SETTLE_H_)
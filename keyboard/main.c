@@ -43,6 +43,7 @@
 
 #include "app_error.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "ble.h"
 #include "ble_bas.h"
 #include "ble_dis.h"
@@ -53,6 +54,12 @@
 #include "ble_srv_common.h"
 #include "boards.h"
 #include "keyboard.h"
+#include "keyboard_event.h"
+#include "keyboard_governor.h"
+#include "keyboard_portmap.h"
+#include "keyboard_ramfunc.h"
+#include "keyboard_report.h"
+#include "keyboard_settle.h"
 #include "nrf_delay.h"
 #include "nrf_gpio.h"
 #include "nrf_ble_gatt.h"
@@ -105,63 +112,33 @@ NRF_LOG_MODULE_REGISTER();
 #define OUTPUT_REPORT_INDEX     0                                       /**< Index of Output Report. */
 #define OUTPUT_REPORT_MAX_LEN   1                                       /**< Maximum length of Output Report. */
 #define INPUT_REPORT_KEYS_INDEX 0                                       /**< Index of Input Report. */
+#define INPUT_REPORT_NKRO_INDEX 1                                       /**< Index of N-key rollover Input Report. */
 #define OUTPUT_REPORT_BIT_MASK_CAPS_LOCK    0x02                        /**< CAPS LOCK bit in Output Report (based on 'LED Page (0x08)' of the Universal Serial Bus HID Usage Tables). */
-#define INPUT_REP_REF_ID        0                                       /**< Id of reference to Keyboard Input Report. */
-#define OUTPUT_REP_REF_ID       0                                       /**< Id of reference to Keyboard Output Report. */
-#define FEATURE_REP_REF_ID      0                                       /**< ID of reference to Keyboard Feature Report. */
+#define INPUT_REP_REF_ID        1                                       /**< Id of reference to Keyboard Input Report. */
+#define INPUT_REP_NKRO_REF_ID   2                                       /**< Id of reference to N-key rollover Keyboard Input Report. */
+#define OUTPUT_REP_REF_ID       1                                       /**< Id of reference to Keyboard Output Report. */
+#define FEATURE_REP_REF_ID      1                                       /**< ID of reference to Keyboard Feature Report. */
 #define FEATURE_REPORT_MAX_LEN  2                                       /**< Maximum length of Feature Report. */
 #define FEATURE_REPORT_INDEX    0                                       /**< Index of Feature Report. */
 
 #define BASE_USB_HID_SPEC_VERSION   0x0101                              /**< Version number of base USB HID Specification implemented by this application. */
 
-#define INPUT_REPORT_KEYS_MAX_LEN   8                                   /**< Maximum length of the Input Report characteristic. */
-
-#define P0_PIN_MSK(n)   (((n) >> 5) == 0 ? (1 << ((n) & 0x1F)) : 0)
-#define P1_PIN_MSK(n)   (((n) >> 5) == 1 ? (1 << ((n) & 0x1F)) : 0)
-
-#define P0_PA_MSK  (0 \
-    | P0_PIN_MSK(PA0) \
-    | P0_PIN_MSK(PA1) \
-    | P0_PIN_MSK(PA2) \
-    | P0_PIN_MSK(PA3) \
-    | P0_PIN_MSK(PA4) \
-    | P0_PIN_MSK(PA5) \
-    | P0_PIN_MSK(PA6) \
-    | P0_PIN_MSK(PA7) \
-    )
-
-#define P1_PA_MSK  (0 \
-    | P1_PIN_MSK(PA0) \
-    | P1_PIN_MSK(PA1) \
-    | P1_PIN_MSK(PA2) \
-    | P1_PIN_MSK(PA3) \
-    | P1_PIN_MSK(PA4) \
-    | P1_PIN_MSK(PA5) \
-    | P1_PIN_MSK(PA6) \
-    | P1_PIN_MSK(PA7) \
-    )
-
-#define P0_PB_MSK  (0 \
-    | P0_PIN_MSK(PB0) \
-    | P0_PIN_MSK(PB1) \
-    | P0_PIN_MSK(PB2) \
-    | P0_PIN_MSK(PB3) \
-    | P0_PIN_MSK(PB4) \
-    | P0_PIN_MSK(PB5) \
-    | P0_PIN_MSK(PB6) \
-    | P0_PIN_MSK(PB7) \
-    )
-
-#define P1_PB_MSK  (0 \
-    | P1_PIN_MSK(PB0) \
-    | P1_PIN_MSK(PB1) \
-    | P1_PIN_MSK(PB2) \
-    | P1_PIN_MSK(PB3) \
-    | P1_PIN_MSK(PB4) \
-    | P1_PIN_MSK(PB5) \
-    | P1_PIN_MSK(PB6) \
-    | P1_PIN_MSK(PB7) \
-    )
+#define INPUT_REPORT_KEYS_MAX_LEN   KEYBOARD_REPORT_SIZE                /**< Maximum length of the Input Report characteristic. */
+#define INPUT_REPORT_NKRO_MAX_LEN   KEYBOARD_REPORT_NKRO_SIZE           /**< Maximum length of the N-key rollover Input Report characteristic. */
+
+#define KBD_SETTLE_TICKS        5                                       /**< Row settle time between strobe and column read in RTC ticks (~153 us, the app_timer minimum). */
+#define KBD_SETTLE_US           100                                     /**< Row settle time known to be safe, calibration starts from it. */
+#define KBD_SETTLE_STEP_US      2                                       /**< Settle time decrement while calibrating. */
+#define KBD_SETTLE_REPEATS      4                                       /**< Probes that must all read settled at a settle time. */
+#define KBD_SETTLE_MARGIN_US    2                                       /**< Added to half again the shortest settled time. */
+#define KBD_DEBOUNCE_MODE       DEBOUNCE_MODE_EAGER                     /**< Keys are pressed at once and released when stable. */
+#define KBD_DEBOUNCE_SCANS      3                                       /**< Number of stable scans before a key is released (6 ms at the fastest scan rate). */
+#define KBD_LATCH_INTERVAL      APP_TIMER_TICKS(16)                     /**< Scan intervals from this long on latch the columns between scans. */
+
+#define KBD_RADIO_SYNC_ENABLED  1                                       /**< Scan just ahead of the connection events at intervals from the connection interval on. */
+#define KBD_SYNC_PERIOD_US      (((KBD_SETTLE_TICKS + 1) * 1000000) / 32768) /**< Longest settle timer period, a timer start rounds up to the next RTC tick. */
+#define KBD_SYNC_REPORT_US      300                                     /**< Report build and submission after a scan, added to the radio notification lead. */
+#define KBD_CONN_INTERVAL_TICKS(units)  (APP_TIMER_TICKS(5 * (units)) / 4) /**< Connection interval in 1.25 ms units to app_timer ticks. */
 
 
 static void log_init(void);
@@ -182,6 +159,28 @@ static void peer_manager_init(void);
 static void advertising_start(void);
 
 static void kbd_timer_handler(void* context);
+static void kbd_settle_timer_handler(void* context);
+static void kbd_scan_complete(struct keyboard_return keyboard_return);
+static void kbd_scan_rate_update(void);
+static uint32_t kbd_scan_period(void);
+static void kbd_timer_restart(void);
+#if KBD_RADIO_SYNC_ENABLED
+static void kbd_radio_sync_init(void);
+static uint8_t kbd_radio_sync_distance(void);
+static void kbd_radio_sync_set(uint16_t conn_interval);
+#endif
+static void kbd_park(void);
+static void kbd_wake(void);
+static void kbd_latch_arm(uint8_t rows);
+static void kbd_latch_sense(void);
+static bool kbd_latch_disarm(void);
+static bool kbd_latch_columns(void);
+static void kbd_extra_sense(void);
+static void kbd_events_process(void);
+static void kbd_report_submit(void);
+static bool kbd_report_send(void);
+static void kbd_report_mode_update(void);
+static bool kbd_report_nkro_subscribed(void);
 static void ble_evt_handler(ble_evt_t const* evt, void* ctx);
 static void gatt_evt_handler(nrf_ble_gatt_t* gatt, nrf_ble_gatt_evt_t const* evt);
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt);
@@ -194,8 +193,14 @@ static void conn_params_error_handler(uint32_t nrf_error);
 static void pm_evt_handler(pm_evt_t const* evt);
 static void pa_cfg_output(void);
 static void pb_cfg_input_pull_high(void);
+static void pb_cfg_output(void);
+static void pa_cfg_input_pull_high(void);
+static void pb_out_write(uint8_t value);
+static uint8_t pa_in_read(void);
 static void pa_out_write(uint8_t value);
 static uint8_t pb_in_read(void);
+static uint8_t extra_in_read(void);
+static uint8_t pa_settle_probe(uint8_t pa, uint16_t delay_us);
 
 
 static const uint8_t report_map_data[] =
@@ -203,6 +208,7 @@ static const uint8_t report_map_data[] =
     0x05, 0x01,       // Usage Page (Generic Desktop)
     0x09, 0x06,       // Usage (Keyboard)
     0xA1, 0x01,       // Collection (Application)
+    0x85, 0x01,       // Report ID (1)
     0x05, 0x07,       // Usage Page (Key Codes)
 
     // Modifier key input report
@@ -248,6 +254,30 @@ static const uint8_t report_map_data[] =
     0x95, 0x02,       // Report Count (2)
     0xB1, 0x02,       // Feature (Data, Variable, Absolute)
 
+    0xC0,             // End Collection (Application)
+
+    // N-key rollover keyboard, one bit per usage
+    0x05, 0x01,       // Usage Page (Generic Desktop)
+    0x09, 0x06,       // Usage (Keyboard)
+    0xA1, 0x01,       // Collection (Application)
+    0x85, 0x02,       // Report ID (2)
+    0x05, 0x07,       // Usage Page (Key Codes)
+
+    // Modifier key input report
+    0x19, 0xe0,       // Usage Minimum (224)
+    0x29, 0xe7,       // Usage Maximum (231)
+    0x15, 0x00,       // Logical Minimum (0)
+    0x25, 0x01,       // Logical Maximum (1)
+    0x75, 0x01,       // Report Size (1)
+    0x95, 0x08,       // Report Count (8)
+    0x81, 0x02,       // Input (Data, Variable, Absolute)
+
+    // Key input bitmap (usages 0 to 103)
+    0x19, 0x00,       // Usage Minimum (0)
+    0x29, 0x67,       // Usage Maximum (103)
+    0x95, 0x68,       // Report Count (104)
+    0x81, 0x02,       // Input (Data, Variable, Absolute) Key bitmap(13 bytes)
+
     0xC0              // End Collection (Application)
 };
 
@@ -255,7 +285,7 @@ static const ble_uuid128_t sxy_uuid_base =
 {
     .uuid128 = SXY_UUID_BASE,
 };
-static const uint32_t porta_pins[] = 
+static KEYBOARD_RAMDATA const uint32_t porta_pins[] = 
 {
     PA0,
     PA1,
@@ -267,7 +297,7 @@ static const uint32_t porta_pins[] =
     PA7,
 };
 
-static const uint32_t portb_pins[] = 
+static KEYBOARD_RAMDATA const uint32_t portb_pins[] = 
 {
     PB0,
     PB1,
@@ -279,16 +309,69 @@ static const uint32_t portb_pins[] =
     PB7,
 };
 
+// Scan rate steps down while the matrix is unchanged and returns to the top on any change.
+// The fastest tier is paced for the split-phase software scan, which takes up to about 1.4 ms
+// of settle timer periods. A 1 ms tick would start only every other scan, so it runs at 2 ms.
+// With all keys up the timer is stopped and the first key press is caught by PORT SENSE.
+static KEYBOARD_RAMDATA const struct keyboard_governor_tier kbd_governor_tiers[] =
+{
+    { APP_TIMER_TICKS(2),   APP_TIMER_TICKS(250) },                     // 500 Hz while typing
+    { APP_TIMER_TICKS(8),   APP_TIMER_TICKS(2000) },                    // 125 Hz
+    { APP_TIMER_TICKS(32),  APP_TIMER_TICKS(5000) },                    // 30 Hz, taps are caught by the column latches
+    { APP_TIMER_TICKS(100), 0 },                                        // 10 Hz while keys are held, their rows are not latched
+    { 0,                    0 },                                        // Parked until a key pulls a column low
+};
+
+static struct keyboard_event_ring kbd_events;
+static struct keyboard_report_ctx kbd_report;
+static uint32_t kbd_report_in_flight;                                   // Notifications not yet completed by the SoftDevice
+static bool kbd_report_retry;                                           // The built report is still to be sent
+static bool kbd_report_retry_ready;                                     // A notification has completed or the scan timer ticked since the last send
+
 static const struct keyboard_init_data kbd_init_data =
 {
     .pa_cfg_output = pa_cfg_output,
     .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
     .pa_out_write = pa_out_write,
     .pb_in_read = pb_in_read,
+    .scan_complete = kbd_scan_complete,
+    .debounce_mode = KBD_DEBOUNCE_MODE,
+    .debounce_scans = KBD_DEBOUNCE_SCANS,
+    .events = &kbd_events,
+    .timestamp = app_timer_cnt_get,
+    // RTC1 counts 24 bits, row times are compared within that
+    .timestamp_mask = APP_TIMER_MAX_CNT_VAL,
+    .incremental_scan = true,
+    .extra_in_read = extra_in_read,
+    // No K0-K2 lines on the connector, a C128 keyboard is read as its C64 matrix
+    .profile = &keyboard_profile_c64,
+    .pb_cfg_output = pb_cfg_output,
+    .pa_cfg_input_pull_high = pa_cfg_input_pull_high,
+    .pb_out_write = pb_out_write,
+    .pa_in_read = pa_in_read,
+};
+
+static const struct keyboard_settle_init_data kbd_settle_init_data =
+{
+    .probe = pa_settle_probe,
+    .max_us = KBD_SETTLE_US,
+    .step_us = KBD_SETTLE_STEP_US,
+    .repeats = KBD_SETTLE_REPEATS,
+    .margin_us = KBD_SETTLE_MARGIN_US,
 };
 
 static struct keyboard_ctx kbd_ctx;
+static struct keyboard_settle_ctx kbd_settle;
+static bool kbd_latch_armed;
+static bool kbd_latch_pending;                                          // Column sense is armed on the next settle timer tick
+#if KBD_RADIO_SYNC_ENABLED
+static uint32_t kbd_sync_interval;                                      // Connection interval in app_timer ticks, 0 while not connected
+static uint32_t kbd_sync_divider;                                       // Connection events per scan, 0 while the scan timer runs
+static uint32_t kbd_sync_count;
+#endif
+static struct keyboard_governor_ctx kbd_governor;
 APP_TIMER_DEF(kbd_timer);
+APP_TIMER_DEF(kbd_settle_timer);
 NRF_SDH_BLE_OBSERVER(ble_observer, APP_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
 NRF_BLE_GATT_DEF(gatt);                                                 /**< GATT module instance. */
 BLE_ADVERTISING_DEF(advertising);                                       /**< Advertising module instance. */
@@ -296,6 +379,7 @@ BLE_BAS_DEF(bas);                                                       /**< Bat
 BLE_HIDS_DEF(hids,                                                      /**< Structure used to identify the HID service. */
              NRF_SDH_BLE_TOTAL_LINK_COUNT,
              INPUT_REPORT_KEYS_MAX_LEN,
+             INPUT_REPORT_NKRO_MAX_LEN,
              OUTPUT_REPORT_MAX_LEN,
              FEATURE_REPORT_MAX_LEN);
 
@@ -305,10 +389,11 @@ static ble_uuid_t adv_uuids[] =
     {SXY_SERVICE_UUID, BLE_UUID_TYPE_UNKNOWN}, // UUID type will be set at runtime
     {BLE_UUID_HUMAN_INTERFACE_DEVICE_SERVICE, BLE_UUID_TYPE_BLE},
 };
-static ble_hids_inp_rep_init_t input_report_array[1];
+static ble_hids_inp_rep_init_t input_report_array[2];
 static ble_hids_outp_rep_init_t output_report_array[1];
 static ble_hids_feature_rep_init_t feature_report_array[1];
 static bool in_boot_mode;
+static uint16_t conn_handle = BLE_CONN_HANDLE_INVALID;
 
 
 int main(void)
@@ -318,6 +403,9 @@ int main(void)
     power_management_init();
     keyboard_module_init();
     ble_stack_init();
+#if KBD_RADIO_SYNC_ENABLED
+    kbd_radio_sync_init();
+#endif
     gap_params_init();
     gatt_init();
     advertising_init();
@@ -330,6 +418,8 @@ int main(void)
 
     for (;;)
     {
+        kbd_events_process();
+
         if (!NRF_LOG_PROCESS())
             nrf_pwr_mgmt_run();
     }
@@ -367,13 +457,42 @@ static void keyboard_module_init(void)
 {
     ret_code_t err_code;
 
+    nrf_gpio_cfg_input(RESTORE, NRF_GPIO_PIN_PULLUP);
+    nrf_gpio_cfg_input(SHIFT_LOCK, NRF_GPIO_PIN_PULLUP);
+    nrf_gpio_cfg_output(LED_SHIFT_LOCK);
+
+    // DETECT is raised from the pin latches, which hold an edge until cleared
+    nrf_gpio_port_detect_latch_set(NRF_P0, true);
+    nrf_gpio_port_detect_latch_set(NRF_P1, true);
+
+    keyboard_event_ring_init(&kbd_events);
+    keyboard_report_init(&kbd_report, kbd_init_data.profile);
     keyboard_init(&kbd_ctx, &kbd_init_data);
+    kbd_extra_sense();
+
+    if (!keyboard_settle_calibrate(&kbd_settle, &kbd_settle_init_data))
+        NRF_LOG_WARNING("keyboard_module_init: settle calibration incomplete, keys held?");
+
+    NRF_LOG_INFO("keyboard_module_init: settle %u us max, %u us per scan",
+            keyboard_settle_max_us(&kbd_settle),
+            keyboard_settle_total_us(&kbd_settle));
+
+    keyboard_governor_init(&kbd_governor, kbd_governor_tiers, ARRAY_SIZE(kbd_governor_tiers));
+
+    // Wake-up runs at the priority of the scan timer, so it never preempts a scan. The extra
+    // lines are sensed all the time, the columns only while parked.
+    NRF_GPIOTE->EVENTS_PORT = 0;
+    NRF_GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Msk;
+    NVIC_SetPriority(GPIOTE_IRQn, APP_IRQ_PRIORITY_LOW);
+    NVIC_EnableIRQ(GPIOTE_IRQn);
 
     err_code = app_timer_create(&kbd_timer, APP_TIMER_MODE_REPEATED, kbd_timer_handler);
     APP_ERROR_CHECK(err_code);
 
-    err_code = app_timer_start(kbd_timer, APP_TIMER_TICKS(1000/60), NULL);
+    err_code = app_timer_create(&kbd_settle_timer, APP_TIMER_MODE_SINGLE_SHOT, kbd_settle_timer_handler);
     APP_ERROR_CHECK(err_code);
+
+    kbd_timer_restart();
 }
 
 static void ble_stack_init(void)
@@ -495,7 +614,7 @@ static void hids_init(void)
     uint8_t hid_info_flags;
 
     in_boot_mode = false;
-    memset((void*) input_report_array, 0, sizeof(ble_hids_inp_rep_init_t));
+    memset((void*) input_report_array, 0, sizeof(input_report_array));
     memset((void*) output_report_array, 0, sizeof(ble_hids_outp_rep_init_t));
     memset((void*) feature_report_array, 0, sizeof(ble_hids_feature_rep_init_t));
     input_report = &input_report_array[INPUT_REPORT_KEYS_INDEX];
@@ -507,6 +626,15 @@ static void hids_init(void)
     input_report->sec.wr = SEC_OPEN;
     input_report->sec.rd = SEC_OPEN;
 
+    input_report = &input_report_array[INPUT_REPORT_NKRO_INDEX];
+    input_report->max_len = INPUT_REPORT_NKRO_MAX_LEN;
+    input_report->rep_ref.report_id = INPUT_REP_NKRO_REF_ID;
+    input_report->rep_ref.report_type = BLE_HIDS_REP_TYPE_INPUT;
+
+    input_report->sec.cccd_wr = SEC_OPEN;
+    input_report->sec.wr = SEC_OPEN;
+    input_report->sec.rd = SEC_OPEN;
+
     output_report = &output_report_array[OUTPUT_REPORT_INDEX];
     output_report->max_len = OUTPUT_REPORT_MAX_LEN;
     output_report->rep_ref.report_id = OUTPUT_REP_REF_ID;
@@ -532,7 +660,7 @@ static void hids_init(void)
     hids_init_obj.error_handler = service_error_handler;
     hids_init_obj.is_kb = true;
     hids_init_obj.is_mouse = false;
-    hids_init_obj.inp_rep_count = 1;
+    hids_init_obj.inp_rep_count = sizeof(input_report_array) / sizeof(input_report_array[0]);
     hids_init_obj.p_inp_rep_array = input_report_array;
     hids_init_obj.outp_rep_count = 1;
     hids_init_obj.p_outp_rep_array = output_report_array;
@@ -614,14 +742,54 @@ static void advertising_start(void)
     APP_ERROR_CHECK(err_code);
 }
 
-static void kbd_timer_handler(void* context)
+static KEYBOARD_RAMFUNC void kbd_timer_handler(void* context)
+{
+    ret_code_t err_code;
+
+    // A report that found no buffer is sent again at the scan rate at the most
+    __atomic_store_n(&kbd_report_retry_ready, true, __ATOMIC_RELEASE);
+
+    // A column latched since the last slow scan was a key going down, however short
+    if ((kbd_latch_armed || kbd_latch_pending) && kbd_latch_disarm())
+    {
+        kbd_wake();
+        return;
+    }
+
+    // Rows are read on settle timer ticks, the CPU sleeps while they settle. A scan still in
+    // progress is left to complete.
+    if (!keyboard_scan_start(&kbd_ctx))
+        return;
+
+    err_code = app_timer_start(kbd_settle_timer, KBD_SETTLE_TICKS, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static KEYBOARD_RAMFUNC void kbd_settle_timer_handler(void* context)
 {
-    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+    ret_code_t err_code;
+
+    if (kbd_latch_pending)
+    {
+        kbd_latch_sense();
+        return;
+    }
+
+    if (keyboard_scan_continue(&kbd_ctx))
+    {
+        err_code = app_timer_start(kbd_settle_timer, KBD_SETTLE_TICKS, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+static KEYBOARD_RAMFUNC void kbd_scan_complete(struct keyboard_return keyboard_return)
+{
+    kbd_scan_rate_update();
 
     switch (keyboard_return.keyboard_scan_return)
     {
         case SCAN_RETURN_SUCCESS:
-            NRF_LOG_DEBUG("kbd_timer_handler: alpha_num: %x, non_alpha_flag_x: %x, non_alpha_flag_y: %x", 
+            NRF_LOG_DEBUG("kbd_scan_complete: alpha_num: %x, non_alpha_flag_x: %x, non_alpha_flag_y: %x", 
                     keyboard_return.alpha_num,
                     keyboard_return.non_alpha_flag_x,
                     keyboard_return.non_alpha_flag_y);
@@ -631,24 +799,404 @@ static void kbd_timer_handler(void* context)
             break;
 
         case SCAN_RETURN_AWAITING_NO_ACTIVITY:
-            NRF_LOG_DEBUG("kbd_timer_handler: SCAN_RETURN_AWAITING_NO_ACTIVITY");
+            NRF_LOG_DEBUG("kbd_scan_complete: SCAN_RETURN_AWAITING_NO_ACTIVITY");
             break;
 
         case SCAN_RETURN_KEY_SHADOWING_DETECTED:
-            NRF_LOG_DEBUG("kbd_timer_handler: SCAN_RETURN_KEY_SHADOWING_DETECTED");
+            NRF_LOG_DEBUG("kbd_scan_complete: SCAN_RETURN_KEY_SHADOWING_DETECTED");
             break;
 
         case SCAN_RETURN_MULTIPLE_KEYS_WITHIN_ONE_SCAN:
-            NRF_LOG_DEBUG("kbd_timer_handler: SCAN_RETURN_MULTIPLE_KEYS_WITHIN_ONE_SCAN");
+            NRF_LOG_DEBUG("kbd_scan_complete: SCAN_RETURN_MULTIPLE_KEYS_WITHIN_ONE_SCAN");
             break;
 
         default:
             // Should not happen
-            NRF_LOG_INFO("kbd_timer_handler: unknown code %d", (int) keyboard_return.keyboard_scan_return);
+            NRF_LOG_INFO("kbd_scan_complete: unknown code %d", (int) keyboard_return.keyboard_scan_return);
             break;
     }
 }
 
+static KEYBOARD_RAMFUNC void kbd_scan_rate_update(void)
+{
+    uint8_t rows = 0;
+
+    if (keyboard_governor_update(&kbd_governor, kbd_ctx.raw, kbd_scan_period()))
+    {
+        kbd_timer_restart();
+
+        if (keyboard_governor_parked(&kbd_governor))
+        {
+            kbd_park();
+            return;
+        }
+    }
+
+    if (keyboard_governor_interval(&kbd_governor) < KBD_LATCH_INTERVAL)
+        return;
+
+    // Rows with keys held stay high, they would hold their columns low
+    for (int row = 0; row < 8; row++)
+    {
+        if (!(uint8_t) (kbd_ctx.raw >> (8 * row)))
+            rows |= 1 << row;
+    }
+
+    kbd_latch_arm(rows);
+}
+
+// Time between scans at the current rate, the governor counts its hold times in it
+static KEYBOARD_RAMFUNC uint32_t kbd_scan_period(void)
+{
+#if KBD_RADIO_SYNC_ENABLED
+    // Synced scans follow the connection events, not the governor interval
+    if (kbd_sync_divider)
+        return kbd_sync_divider * kbd_sync_interval;
+#endif
+
+    return keyboard_governor_interval(&kbd_governor);
+}
+
+// Runs the scan timer at the governor interval. While connected, intervals from the connection
+// interval on scan every so many connection events instead, just before the radio is active, so
+// the state scanned always makes the next packet. Faster intervals already do.
+static KEYBOARD_RAMFUNC void kbd_timer_restart(void)
+{
+    ret_code_t err_code;
+    uint32_t interval = keyboard_governor_interval(&kbd_governor);
+
+    err_code = app_timer_stop(kbd_timer);
+    APP_ERROR_CHECK(err_code);
+
+    if (keyboard_governor_parked(&kbd_governor))
+        interval = 0;
+
+#if KBD_RADIO_SYNC_ENABLED
+    kbd_sync_divider = 0;
+
+    if (interval && kbd_sync_interval && interval >= kbd_sync_interval)
+    {
+        kbd_sync_divider = (interval + kbd_sync_interval / 2) / kbd_sync_interval;
+        kbd_sync_count = 0;
+        return;
+    }
+#endif
+
+    if (!interval)
+        return;
+
+    err_code = app_timer_start(kbd_timer, interval, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+#if KBD_RADIO_SYNC_ENABLED
+// Radio notifications are set up before any radio activity, the SoftDevice refuses them later
+static void kbd_radio_sync_init(void)
+{
+    ret_code_t err_code;
+
+    // Same priority as the scan timer, the two never preempt each other
+    err_code = sd_nvic_ClearPendingIRQ(RADIO_NOTIFICATION_IRQn);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = sd_nvic_SetPriority(RADIO_NOTIFICATION_IRQn, APP_IRQ_PRIORITY_LOW);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = sd_nvic_EnableIRQ(RADIO_NOTIFICATION_IRQn);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_ACTIVE, kbd_radio_sync_distance());
+    APP_ERROR_CHECK(err_code);
+}
+
+// Shortest radio notification lead that fits a full scan pass at the calibrated settle times and
+// the report submission. A pass that also needs the reverse ghost scan takes about twice as long,
+// its report makes the following connection event.
+static uint8_t kbd_radio_sync_distance(void)
+{
+    static const uint16_t distance_us[] =                               // From NRF_RADIO_NOTIFICATION_DISTANCE_800US on
+    {
+        800, 1740, 2680, 3620, 4560, 5500,
+    };
+    uint32_t lead_us = keyboard_settle_pass_us(&kbd_settle, KBD_SYNC_PERIOD_US) + KBD_SYNC_REPORT_US;
+    int i = 0;
+
+    while (i < ARRAY_SIZE(distance_us) - 1 && distance_us[i] < lead_us)
+        i++;
+
+    NRF_LOG_INFO("kbd_radio_sync_distance: %u us for a %u us scan and report", distance_us[i], lead_us);
+    return NRF_RADIO_NOTIFICATION_DISTANCE_800US + i;
+}
+
+// Called from the BLE events with the connection interval, 0 when disconnected
+static void kbd_radio_sync_set(uint16_t conn_interval)
+{
+    CRITICAL_REGION_ENTER();
+    kbd_sync_interval = conn_interval ? KBD_CONN_INTERVAL_TICKS(conn_interval) : 0;
+    kbd_timer_restart();
+    CRITICAL_REGION_EXIT();
+}
+
+// Ahead of every radio event, advertising included, but only connection events pace the scan
+KEYBOARD_RAMFUNC void RADIO_NOTIFICATION_IRQHandler(void)
+{
+    if (!kbd_sync_divider || ++kbd_sync_count < kbd_sync_divider)
+        return;
+
+    kbd_sync_count = 0;
+    kbd_timer_handler(NULL);
+}
+#endif
+
+static KEYBOARD_RAMFUNC void kbd_park(void)
+{
+    // Woken from kbd_latch_sense() if a key is already down
+    kbd_latch_arm(0xFF);
+}
+
+static KEYBOARD_RAMFUNC void kbd_wake(void)
+{
+    kbd_latch_disarm();
+    keyboard_governor_wake(&kbd_governor);
+    kbd_timer_restart();
+
+    // Scan at once rather than one interval from now
+    kbd_timer_handler(NULL);
+}
+
+// Drives rows low and senses the columns, so a key going down on one of the rows latches its
+// column and raises DETECT even if it is up again before the next scan. The columns held low by
+// the last strobe of the scan recover first, the sense is armed on the next settle timer tick.
+static KEYBOARD_RAMFUNC void kbd_latch_arm(uint8_t rows)
+{
+    ret_code_t err_code;
+
+    pa_out_write(~rows);
+    kbd_latch_pending = true;
+
+    err_code = app_timer_start(kbd_settle_timer, KBD_SETTLE_TICKS, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static KEYBOARD_RAMFUNC void kbd_latch_sense(void)
+{
+    kbd_latch_pending = false;
+
+    for (int i = 0; i < sizeof(portb_pins) / sizeof(portb_pins[0]); i++)
+    {
+        nrf_gpio_pin_latch_clear(portb_pins[i]);
+        nrf_gpio_cfg_sense_set(portb_pins[i], NRF_GPIO_PIN_SENSE_LOW);
+    }
+
+    kbd_latch_armed = true;
+
+    // While parked, a key pressed since the last scan may already hold DETECT high
+    if (keyboard_governor_parked(&kbd_governor) && pb_in_read() != 0xFF)
+        kbd_wake();
+}
+
+// Returns true if a column was latched while armed, a sense still to be armed is cancelled
+static KEYBOARD_RAMFUNC bool kbd_latch_disarm(void)
+{
+    ret_code_t err_code;
+    bool latched = kbd_latch_columns();
+
+    if (kbd_latch_pending)
+    {
+        kbd_latch_pending = false;
+
+        err_code = app_timer_stop(kbd_settle_timer);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    for (int i = 0; i < sizeof(portb_pins) / sizeof(portb_pins[0]); i++)
+    {
+        nrf_gpio_cfg_sense_set(portb_pins[i], NRF_GPIO_PIN_NOSENSE);
+        nrf_gpio_pin_latch_clear(portb_pins[i]);
+    }
+
+    kbd_latch_armed = false;
+    return latched;
+}
+
+static KEYBOARD_RAMFUNC bool kbd_latch_columns(void)
+{
+    uint32_t latches[GPIO_COUNT];
+
+    nrf_gpio_latches_read(0, GPIO_COUNT, latches);
+    return (latches[0] & P0_PB_MSK) || (latches[1] & P1_PB_MSK);
+}
+
+KEYBOARD_RAMFUNC void GPIOTE_IRQHandler(void)
+{
+    if (NRF_GPIOTE->EVENTS_PORT)
+    {
+        NRF_GPIOTE->EVENTS_PORT = 0;
+        kbd_extra_sense();
+
+        // Already woken by kbd_latch_sense() if the key went down while parking
+        if (keyboard_governor_parked(&kbd_governor) || (kbd_latch_armed && kbd_latch_columns()))
+            kbd_wake();
+    }
+}
+
+static KEYBOARD_RAMFUNC void kbd_extra_sense(void)
+{
+    uint8_t extra = extra_in_read();
+
+    // RESTORE may be up again before the next scan, or scanning may be parked
+    if (extra & KEYBOARD_EXTRA_RESTORE)
+        keyboard_extra_latch(&kbd_ctx, KEYBOARD_EXTRA_RESTORE);
+
+    // Each line is sensed for its next edge only, so DETECT stays low while they are steady and
+    // an engaged SHIFT LOCK neither wakes the CPU again nor masks the columns while parked
+    nrf_gpio_cfg_sense_set(RESTORE, (extra & KEYBOARD_EXTRA_RESTORE) ? NRF_GPIO_PIN_SENSE_HIGH : NRF_GPIO_PIN_SENSE_LOW);
+    nrf_gpio_cfg_sense_set(SHIFT_LOCK, (extra & KEYBOARD_EXTRA_SHIFT_LOCK) ? NRF_GPIO_PIN_SENSE_HIGH : NRF_GPIO_PIN_SENSE_LOW);
+
+    // DETECT follows the latches, a line that already meets its new sense latches again
+    nrf_gpio_pin_latch_clear(RESTORE);
+    nrf_gpio_pin_latch_clear(SHIFT_LOCK);
+
+    nrf_gpio_pin_write(LED_SHIFT_LOCK, (extra & KEYBOARD_EXTRA_SHIFT_LOCK) != 0);
+}
+
+static void kbd_events_process(void)
+{
+    static uint32_t overflows;
+    static uint32_t pending_drops;
+    struct keyboard_event event;
+
+    while (keyboard_event_get(&kbd_events, &event))
+    {
+        NRF_LOG_DEBUG("kbd_events_process: key: %u, pressed: %u, timestamp: %u",
+                event.key,
+                event.pressed,
+                event.timestamp);
+
+        keyboard_report_event(&kbd_report, &event);
+    }
+
+    kbd_report_submit();
+
+    if (kbd_events.overflows != overflows)
+    {
+        overflows = kbd_events.overflows;
+        NRF_LOG_WARNING("kbd_events_process: %u events dropped", overflows);
+    }
+
+    if (kbd_ctx.pending_drops != pending_drops)
+    {
+        pending_drops = kbd_ctx.pending_drops;
+        NRF_LOG_WARNING("kbd_events_process: %u alphanumeric keys dropped", pending_drops);
+    }
+}
+
+// One report is in flight at a time, the next state is sent once the SoftDevice has completed it.
+// Changes in between coalesce in the queue, so the host sees each required state in order
+// without the SoftDevice buffers filling up with states already superseded.
+// A report the SoftDevice has no buffer for is kept built and sent again, the queue behind it
+// collapses meanwhile but never loses a release.
+static void kbd_report_submit(void)
+{
+    if (__atomic_load_n(&kbd_report_in_flight, __ATOMIC_ACQUIRE))
+        return;
+
+    if (kbd_report_retry)
+    {
+        // Sending again before a buffer is freed would only fail again. That is on a completed
+        // notification, or with nothing in flight to complete, no sooner than the next scan.
+        if (!__atomic_load_n(&kbd_report_retry_ready, __ATOMIC_ACQUIRE))
+            return;
+
+        kbd_report.stats.retries++;
+
+        if (!kbd_report_send())
+            return;
+    }
+
+    // A state that changes nothing, or that is not sent while disconnected or unsubscribed, leaves
+    // nothing in flight and the next one is taken at once
+    while (!__atomic_load_n(&kbd_report_in_flight, __ATOMIC_ACQUIRE) && keyboard_report_pending(&kbd_report))
+    {
+        if (keyboard_report_build(&kbd_report) && !kbd_report_send())
+            return;
+    }
+}
+
+// Returns false if the report is to be sent again
+static bool kbd_report_send(void)
+{
+    ret_code_t err_code;
+
+    kbd_report_retry = false;
+
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+        return true;
+
+    // Completions and scans from here on allow a retry
+    __atomic_store_n(&kbd_report_retry_ready, false, __ATOMIC_RELEASE);
+
+    // The 6-key report has the boot layout, boot protocol sends the same buffer. The report module
+    // switches protocol like the N-key rollover report, the keys are released on the one left first.
+    if (kbd_report.boot)
+        err_code = ble_hids_boot_kb_inp_rep_send(&hids, INPUT_REPORT_KEYS_MAX_LEN, kbd_report.report, conn_handle);
+    else if (kbd_report.nkro)
+        err_code = ble_hids_inp_rep_send(&hids, INPUT_REPORT_NKRO_INDEX, INPUT_REPORT_NKRO_MAX_LEN, kbd_report.nkro_report, conn_handle);
+    else
+        err_code = ble_hids_inp_rep_send(&hids, INPUT_REPORT_KEYS_INDEX, INPUT_REPORT_KEYS_MAX_LEN, kbd_report.report, conn_handle);
+
+    if (err_code == NRF_SUCCESS)
+    {
+        __atomic_fetch_add(&kbd_report_in_flight, 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // No buffer left in the SoftDevice
+    if (err_code == NRF_ERROR_RESOURCES || err_code == NRF_ERROR_BUSY)
+    {
+        kbd_report_retry = true;
+        return false;
+    }
+
+    // Not yet subscribed
+    if (err_code != NRF_ERROR_INVALID_STATE &&
+        err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    return true;
+}
+
+// Boot protocol has the 6-key report only
+static void kbd_report_mode_update(void)
+{
+    keyboard_report_boot(&kbd_report, in_boot_mode);
+    keyboard_report_nkro(&kbd_report, !in_boot_mode && kbd_report_nkro_subscribed());
+}
+
+// A bonded host gets its subscription back from the stored system attributes without writing
+// the CCCD again, so the CCCD itself is read rather than the writes tracked
+static bool kbd_report_nkro_subscribed(void)
+{
+    uint8_t cccd[BLE_CCCD_VALUE_LEN];
+    ble_gatts_value_t value =
+    {
+        .len = sizeof(cccd),
+        .offset = 0,
+        .p_value = cccd,
+    };
+
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+        return false;
+
+    // Fails while the system attributes of the connection are not yet set
+    if (sd_ble_gatts_value_get(conn_handle, hids.p_inp_rep_array[INPUT_REPORT_NKRO_INDEX].char_handles.cccd_handle, &value) != NRF_SUCCESS)
+        return false;
+
+    return ble_srv_is_notification_enabled(cccd);
+}
+
 static void ble_evt_handler(ble_evt_t const* evt, void* ctx)
 {
     UNUSED_PARAMETER(ctx);
@@ -656,6 +1204,45 @@ static void ble_evt_handler(ble_evt_t const* evt, void* ctx)
 
     switch (evt->header.evt_id)
     {
+        case BLE_GAP_EVT_CONNECTED:
+            conn_handle = evt->evt.gap_evt.conn_handle;
+#if KBD_RADIO_SYNC_ENABLED
+            kbd_radio_sync_set(evt->evt.gap_evt.params.connected.conn_params.max_conn_interval);
+#endif
+            kbd_report_mode_update();
+            break;
+
+#if KBD_RADIO_SYNC_ENABLED
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            kbd_radio_sync_set(evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval);
+            break;
+#endif
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            conn_handle = BLE_CONN_HANDLE_INVALID;
+#if KBD_RADIO_SYNC_ENABLED
+            kbd_radio_sync_set(0);
+#endif
+            __atomic_store_n(&kbd_report_in_flight, 0, __ATOMIC_RELEASE);
+            kbd_report_retry = false;
+
+            NRF_LOG_INFO("Reports queued: %u, collapsed: %u, retries: %u, queue max: %u",
+                    kbd_report.stats.queued,
+                    kbd_report.stats.collapsed,
+                    kbd_report.stats.retries,
+                    kbd_report.stats.queue_max);
+
+            // Every connection starts in report protocol
+            in_boot_mode = false;
+            kbd_report_mode_update();
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            // Reports are the only notifications, kbd_events_process() submits the next ones
+            __atomic_fetch_sub(&kbd_report_in_flight, evt->evt.gatts_evt.params.hvn_tx_complete.count, __ATOMIC_RELEASE);
+            __atomic_store_n(&kbd_report_retry_ready, true, __ATOMIC_RELEASE);
+            break;
+
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
             {
                 NRF_LOG_DEBUG("PHY update request.");
@@ -700,10 +1287,12 @@ static void on_hids_evt(ble_hids_t* hids, ble_hids_evt_t* evt)
     {
         case BLE_HIDS_EVT_BOOT_MODE_ENTERED:
             in_boot_mode = true;
+            kbd_report_mode_update();
             break;
 
         case BLE_HIDS_EVT_REPORT_MODE_ENTERED:
             in_boot_mode = false;
+            kbd_report_mode_update();
             break;
 
         case BLE_HIDS_EVT_REP_CHAR_WRITE:
@@ -711,6 +1300,14 @@ static void on_hids_evt(ble_hids_t* hids, ble_hids_evt_t* evt)
             break;
 
         case BLE_HIDS_EVT_NOTIF_ENABLED:
+        case BLE_HIDS_EVT_NOTIF_DISABLED:
+            // Hosts that cannot parse the bitmap leave it unsubscribed and get the 6-key report
+            if (evt->params.notification.char_id.uuid == BLE_UUID_REPORT_CHAR &&
+                evt->params.notification.char_id.rep_type == BLE_HIDS_REP_TYPE_INPUT &&
+                evt->params.notification.char_id.rep_index == INPUT_REPORT_NKRO_INDEX)
+            {
+                kbd_report_mode_update();
+            }
             break;
 
         default:
@@ -798,6 +1395,18 @@ static void pm_evt_handler(pm_evt_t const* evt)
     pm_handler_on_pm_evt(evt);
     pm_handler_disconnect_on_sec_failure(evt);
     pm_handler_flash_clean(evt);
+
+    switch (evt->evt_id)
+    {
+        case PM_EVT_LOCAL_DB_CACHE_APPLIED:
+        case PM_EVT_CONN_SEC_SUCCEEDED:
+            // The CCCDs of a bonded host are restored now
+            kbd_report_mode_update();
+            break;
+
+        default:
+            break;
+    }
 }
 
 static void pa_cfg_output(void)
@@ -812,48 +1421,91 @@ static void pb_cfg_input_pull_high(void)
         nrf_gpio_cfg_input(portb_pins[i], NRF_GPIO_PIN_PULLUP);
 }
 
-static void pa_out_write(uint8_t value)
+static KEYBOARD_RAMFUNC void pb_cfg_output(void)
 {
-    uint32_t p0_clr_msk = 0;
-    uint32_t p0_set_msk = 0;
-    uint32_t p1_clr_msk = 0;
-    uint32_t p1_set_msk = 0;
+    nrf_gpio_port_dir_output_set(NRF_P0, P0_PB_MSK);
+    nrf_gpio_port_dir_output_set(NRF_P1, P1_PB_MSK);
+}
 
-    for (int i = 0; i < 8; i++, value >>= 1)
+static KEYBOARD_RAMFUNC void pa_cfg_input_pull_high(void)
+{
+    for (int i = 0; i < sizeof(porta_pins) / sizeof(porta_pins[0]); i++)
+        nrf_gpio_cfg_input(porta_pins[i], NRF_GPIO_PIN_PULLUP);
+}
+
+static KEYBOARD_RAMFUNC void pb_out_write(uint8_t value)
+{
+    uint32_t p0_set_msk = keyboard_portmap_scatter(keyboard_portmap_pb_out_p0, value);
+
+    nrf_gpio_port_out_clear(NRF_P0, P0_PB_MSK & ~p0_set_msk);
+    nrf_gpio_port_out_set(NRF_P0, p0_set_msk);
+
+    // The P1 tables are only referenced, and kept in RAM, when the board has PB pins on P1
+    if (P1_PB_MSK)
     {
-        if (value & 1)
-        {
-            p0_set_msk |= P0_PIN_MSK(porta_pins[i]);
-            p1_set_msk |= P1_PIN_MSK(porta_pins[i]);
-        }
-        else
-        {
-            p0_clr_msk |= P0_PIN_MSK(porta_pins[i]);
-            p1_clr_msk |= P1_PIN_MSK(porta_pins[i]);
-        }
+        uint32_t p1_set_msk = keyboard_portmap_scatter(keyboard_portmap_pb_out_p1, value);
+
+        nrf_gpio_port_out_clear(NRF_P1, P1_PB_MSK & ~p1_set_msk);
+        nrf_gpio_port_out_set(NRF_P1, p1_set_msk);
     }
+}
 
-    nrf_gpio_port_out_clear(NRF_P0, p0_clr_msk);
-    nrf_gpio_port_out_clear(NRF_P1, p1_clr_msk);
-    nrf_gpio_port_out_set(NRF_P0, p0_set_msk);
-    nrf_gpio_port_out_set(NRF_P1, p1_set_msk);
-    nrf_delay_us(100);
+static KEYBOARD_RAMFUNC uint8_t pa_in_read(void)
+{
+    uint8_t value = keyboard_portmap_gather(keyboard_portmap_pa_in_p0, nrf_gpio_port_in_read(NRF_P0));
+
+    if (P1_PA_MSK)
+        value |= keyboard_portmap_gather(keyboard_portmap_pa_in_p1, nrf_gpio_port_in_read(NRF_P1));
+
+    return value;
 }
 
-static uint8_t pb_in_read(void)
+static KEYBOARD_RAMFUNC void pa_out_write(uint8_t value)
 {
-    uint32_t p0_msk = nrf_gpio_port_in_read(NRF_P0);
-    uint32_t p1_msk = nrf_gpio_port_in_read(NRF_P1);
+    keyboard_hal_pa_out_write(value);
+}
 
-    uint8_t out = 0;
+static KEYBOARD_RAMFUNC uint8_t pb_in_read(void)
+{
+    return keyboard_hal_pb_in_read();
+}
 
-    for (int i = 0; i < 8; i++)
-    {
-        if ((p0_msk & P0_PIN_MSK(portb_pins[i])) ||
-            (p1_msk & P1_PIN_MSK(portb_pins[i])))
-            out |= (1 << i);
-    }
+static KEYBOARD_RAMFUNC uint8_t extra_in_read(void)
+{
+    uint8_t extra = 0;
 
-    return out;
+    // Both switch to ground
+    if (!nrf_gpio_pin_read(RESTORE))
+        extra |= KEYBOARD_EXTRA_RESTORE;
+
+    if (!nrf_gpio_pin_read(SHIFT_LOCK))
+        extra |= KEYBOARD_EXTRA_SHIFT_LOCK;
+
+    return extra;
 }
 
+static uint8_t pa_settle_probe(uint8_t pa, uint16_t delay_us)
+{
+    uint8_t pb;
+
+    CRITICAL_REGION_ENTER();
+
+    // Columns are discharged with all rows low, so no key shorts a high row to a low column
+    pa_out_write(0x00);
+    nrf_gpio_port_out_clear(NRF_P0, P0_PB_MSK);
+    nrf_gpio_port_out_clear(NRF_P1, P1_PB_MSK);
+    nrf_gpio_port_dir_output_set(NRF_P0, P0_PB_MSK);
+    nrf_gpio_port_dir_output_set(NRF_P1, P1_PB_MSK);
+
+    // Columns are released before the rows are raised, as a key would otherwise short a high row
+    // to a column still driven low. They then recover through their pull-ups, except those held
+    // low by a key on a strobed row
+    nrf_gpio_port_dir_input_set(NRF_P0, P0_PB_MSK);
+    nrf_gpio_port_dir_input_set(NRF_P1, P1_PB_MSK);
+    pa_out_write(pa);
+    nrf_delay_us(delay_us);
+    pb = pb_in_read();
+
+    CRITICAL_REGION_EXIT();
+    return pb;
+}
@@ -45,6 +45,8 @@ extern "C" {
 #endif
 
 #include "nrf_gpio.h"
+#include "keyboard_portmap.h"
+#include "keyboard_ramfunc.h"
 
 // LED definitions for PCA10059
 // Each LED color is considered a separate LED
@@ -134,6 +136,80 @@ extern "C" {
 // LShftLck 22          P1.00
 #define LED_SHIFT_LOCK  NRF_GPIO_PIN_MAP(1, 0)
 
+#define P0_PIN_MSK(n)   (((n) >> 5) == 0 ? (1u << ((n) & 0x1F)) : 0)
+#define P1_PIN_MSK(n)   (((n) >> 5) == 1 ? (1u << ((n) & 0x1F)) : 0)
+
+#define P0_PA_MSK  (0 \
+    | P0_PIN_MSK(PA0) \
+    | P0_PIN_MSK(PA1) \
+    | P0_PIN_MSK(PA2) \
+    | P0_PIN_MSK(PA3) \
+    | P0_PIN_MSK(PA4) \
+    | P0_PIN_MSK(PA5) \
+    | P0_PIN_MSK(PA6) \
+    | P0_PIN_MSK(PA7) \
+    )
+
+#define P1_PA_MSK  (0 \
+    | P1_PIN_MSK(PA0) \
+    | P1_PIN_MSK(PA1) \
+    | P1_PIN_MSK(PA2) \
+    | P1_PIN_MSK(PA3) \
+    | P1_PIN_MSK(PA4) \
+    | P1_PIN_MSK(PA5) \
+    | P1_PIN_MSK(PA6) \
+    | P1_PIN_MSK(PA7) \
+    )
+
+#define P0_PB_MSK  (0 \
+    | P0_PIN_MSK(PB0) \
+    | P0_PIN_MSK(PB1) \
+    | P0_PIN_MSK(PB2) \
+    | P0_PIN_MSK(PB3) \
+    | P0_PIN_MSK(PB4) \
+    | P0_PIN_MSK(PB5) \
+    | P0_PIN_MSK(PB6) \
+    | P0_PIN_MSK(PB7) \
+    )
+
+#define P1_PB_MSK  (0 \
+    | P1_PIN_MSK(PB0) \
+    | P1_PIN_MSK(PB1) \
+    | P1_PIN_MSK(PB2) \
+    | P1_PIN_MSK(PB3) \
+    | P1_PIN_MSK(PB4) \
+    | P1_PIN_MSK(PB5) \
+    | P1_PIN_MSK(PB6) \
+    | P1_PIN_MSK(PB7) \
+    )
+
+// Keyboard port accessors, keyboard.c calls these directly when built with KEYBOARD_HAL_STATIC
+static inline KEYBOARD_RAMFUNC void keyboard_hal_pa_out_write(uint8_t value)
+{
+    uint32_t p0_set_msk = keyboard_portmap_scatter(keyboard_portmap_pa_p0, value);
+
+    nrf_gpio_port_out_clear(NRF_P0, P0_PA_MSK & ~p0_set_msk);
+    nrf_gpio_port_out_set(NRF_P0, p0_set_msk);
+
+    if (P1_PA_MSK)
+    {
+        uint32_t p1_set_msk = keyboard_portmap_scatter(keyboard_portmap_pa_p1, value);
+
+        nrf_gpio_port_out_clear(NRF_P1, P1_PA_MSK & ~p1_set_msk);
+        nrf_gpio_port_out_set(NRF_P1, p1_set_msk);
+    }
+}
+
+static inline KEYBOARD_RAMFUNC uint8_t keyboard_hal_pb_in_read(void)
+{
+    uint8_t value = keyboard_portmap_gather(keyboard_portmap_pb_p0, nrf_gpio_port_in_read(NRF_P0));
+
+    if (P1_PB_MSK)
+        value |= keyboard_portmap_gather(keyboard_portmap_pb_p1, nrf_gpio_port_in_read(NRF_P1));
+
+    return value;
+}
+
 
 
 #ifdef __cplusplus
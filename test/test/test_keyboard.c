@@ -11,6 +11,9 @@
  
 //-- module being tested
 #include "keyboard.h"
+#include "keyboard_debounce.h"
+#include "keyboard_event.h"
+#include "keyboard_profile.h"
 //-- mocked modules
  
 /*******************************************************************************
@@ -31,6 +34,29 @@ static uint8_t pa;
 
 static uint8_t pa_msk;
 static uint8_t pb_msk;
+
+// Columns pulled low by each PA row
+static uint8_t keys[8];
+
+// Columns pulled low only while PA is strobed, seen by the forward scan alone
+static uint8_t forward_ghosts[8];
+
+static uint8_t extra;
+
+// Columns pulled low by each extra row of the profile
+static uint8_t extra_rows[KEYBOARD_PROFILE_MAX_EXTRA_ROWS];
+
+static bool reversed;
+static int reverse_scans;
+static uint8_t pb_out;
+
+static struct keyboard_event_ring event_ring;
+static uint32_t now;
+static uint32_t now_step;       // Added to now by every timestamp read
+
+static struct keyboard_return completed_return;
+static int completed_count;
+static int settle_waits;
  
 /*******************************************************************************
  *    PRIVATE FUNCTIONS
@@ -38,6 +64,7 @@ static uint8_t pb_msk;
 
 static void pa_cfg_output(void)
 {
+    reversed = false;
 }
 
 static void pb_cfg_input_pull_high(void)
@@ -51,10 +78,145 @@ static void pa_out_write(uint8_t value)
 
 static uint8_t pb_in_read(void)
 {
+    uint8_t pb = 0xFF;
+
     if (~pa & pa_msk)
-        return pb_msk ^ 0xFF;
+        pb &= pb_msk ^ 0xFF;
+
+    for (int i = 0; i < 8; i++)
+    {
+        if ((pa & (1 << i)) == 0)
+            pb &= (keys[i] | forward_ghosts[i]) ^ 0xFF;
+    }
+
+    return pb;
+}
+
+static void pb_cfg_output(void)
+{
+    TEST_ASSERT_TRUE(reversed);
+    reverse_scans++;
+}
+
+static void pa_cfg_input_pull_high(void)
+{
+    reversed = true;
+}
+
+static void pb_out_write(uint8_t value)
+{
+    pb_out = value;
+}
+
+static uint8_t pa_in_read(void)
+{
+    uint8_t pa_in = 0xFF;
+
+    TEST_ASSERT_TRUE(reversed);
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (keys[i] & ~pb_out)
+            pa_in &= ~(1 << i);
+    }
+
+    return pa_in;
+}
+
+static uint8_t extra_in_read(void)
+{
+    return extra;
+}
+
+static uint8_t extra_row_read(int row)
+{
+    return extra_rows[row] ^ 0xFF;
+}
 
-    return 0xFF;
+static void init_reverse(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .pb_cfg_output = pb_cfg_output,
+        .pa_cfg_input_pull_high = pa_cfg_input_pull_high,
+        .pb_out_write = pb_out_write,
+        .pa_in_read = pa_in_read,
+    };
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+}
+
+static void settle_wait(int row)
+{
+    settle_waits++;
+}
+
+static void init_incremental(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .settle_wait = settle_wait,
+        .incremental_scan = true,
+    };
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+}
+
+static uint64_t keys_matrix(void)
+{
+    uint64_t matrix = 0;
+
+    for (int row = 0; row < 8; row++)
+        matrix |= (uint64_t) keys[row] << (8 * row);
+
+    return matrix;
+}
+
+static void scan_complete(struct keyboard_return keyboard_return)
+{
+    completed_return = keyboard_return;
+    completed_count++;
+}
+
+static void init_split_phase(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .scan_complete = scan_complete,
+    };
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+}
+
+static uint32_t timestamp(void)
+{
+    uint32_t time = now;
+
+    now += now_step;
+    return time;
+}
+
+// Wraps like the 24 bit RTC1 count behind app_timer_cnt_get
+static uint32_t timestamp_24(void)
+{
+    return timestamp() & 0xFFFFFF;
+}
+
+static bool matrix_scan_start(void)
+{
+    return true;
 }
 
 /*******************************************************************************
@@ -66,6 +228,16 @@ void setUp(void)
     pa = 0;
     pa_msk = 0;
     pb_msk = 0;
+    memset(keys, 0, sizeof(keys));
+    memset(forward_ghosts, 0, sizeof(forward_ghosts));
+    extra = 0;
+    memset(extra_rows, 0, sizeof(extra_rows));
+    now_step = 0;
+    reversed = false;
+    reverse_scans = 0;
+    completed_count = 0;
+    settle_waits = 0;
+    memset(&completed_return, 0, sizeof(completed_return));
     memset(&kbd_ctx, 0, sizeof(kbd_ctx));
 
     const struct keyboard_init_data init =
@@ -117,3 +289,656 @@ void test_f5_key(void)
     TEST_ASSERT_EQUAL_UINT8(0, keyboard_return.non_alpha_flag_y);
 }
 
+
+void test_split_phase_no_activity(void)
+{
+    init_split_phase();
+
+    TEST_ASSERT_TRUE(keyboard_scan_start(&kbd_ctx));
+    TEST_ASSERT_EQUAL_UINT8(0, pa);
+    TEST_ASSERT_FALSE(keyboard_scan_continue(&kbd_ctx));
+
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, completed_return.keyboard_scan_return);
+}
+
+void test_split_phase_z_key(void)
+{
+    int steps = 0;
+
+    init_split_phase();
+    pa_msk = 0x02;
+    pb_msk = 0x10;
+
+    TEST_ASSERT_TRUE(keyboard_scan_start(&kbd_ctx));
+
+    while (keyboard_scan_continue(&kbd_ctx))
+    {
+        // A second scan can not be started while one is in progress
+        TEST_ASSERT_FALSE(keyboard_scan_start(&kbd_ctx));
+        TEST_ASSERT_EQUAL(0, completed_count);
+        steps++;
+    }
+
+    TEST_ASSERT_EQUAL(8, steps);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, completed_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x1A, completed_return.alpha_num);
+    TEST_ASSERT_TRUE(keyboard_scan_start(&kbd_ctx));
+}
+
+void test_matrix_backend_scan(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .scan_complete = scan_complete,
+        .matrix_scan_start = matrix_scan_start,
+    };
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    TEST_ASSERT_TRUE(keyboard_scan_start(&kbd_ctx));
+    TEST_ASSERT_FALSE(keyboard_scan_start(&kbd_ctx));
+    keyboard_scan_matrix(&kbd_ctx, 0);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, completed_return.keyboard_scan_return);
+
+    TEST_ASSERT_TRUE(keyboard_scan_start(&kbd_ctx));
+    keyboard_scan_matrix(&kbd_ctx, KEYBOARD_MATRIX_BIT(1, 4));
+    TEST_ASSERT_EQUAL(2, completed_count);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, completed_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x1A, completed_return.alpha_num);
+}
+
+void test_matrix_backend_scan_not_stale(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .scan_complete = scan_complete,
+        .matrix_scan_start = matrix_scan_start,
+    };
+    struct keyboard_raw raw;
+
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    TEST_ASSERT_TRUE(keyboard_scan_start(&kbd_ctx));
+    keyboard_scan_matrix(&kbd_ctx, KEYBOARD_MATRIX_BIT(1, 4));
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, completed_return.keyboard_scan_return);
+
+    // The last result is not returned again, a hardware scan is started for scan_complete
+    keys[1] = 0x10;     // "Z" seen by the software strobe only
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SCAN_PENDING, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+    TEST_ASSERT_EQUAL(SCAN_STATE_MATRIX, kbd_ctx.scan_state);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SCAN_PENDING, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+    TEST_ASSERT_FALSE(keyboard_scan_raw(&kbd_ctx, &raw));
+    TEST_ASSERT_EQUAL(1, completed_count);
+
+    keyboard_scan_matrix(&kbd_ctx, 0);
+    TEST_ASSERT_EQUAL(2, completed_count);
+    TEST_ASSERT_EQUAL(SCAN_STATE_IDLE, kbd_ctx.scan_state);
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.raw);
+}
+
+void test_matrix_press_and_release(void)
+{
+    keys[1] = 0x10;     // "Z"
+    keys[0] = 0x40;     // F5
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(1, 4) | KEYBOARD_MATRIX_BIT(0, 6), kbd_ctx.matrix);
+    TEST_ASSERT_EQUAL_UINT64(kbd_ctx.matrix, kbd_ctx.pressed);
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.released);
+
+    // Held keys are not returned again
+    keyboard_return = keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.pressed);
+
+    keys[1] = 0;
+    keyboard_return = keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(1, 4), kbd_ctx.released);
+
+    keys[0] = 0;
+    keyboard_return = keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(0, 6), kbd_ctx.released);
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.matrix);
+}
+
+void test_key_pressed_while_other_key_held(void)
+{
+    keys[1] = 0x10;     // "Z"
+    keyboard_scan(&kbd_ctx);
+
+    keys[2] = 0x20;     // "F"
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x06, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(2, 5), kbd_ctx.pressed);
+}
+
+void test_debounced_release(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .debounce_mode = DEBOUNCE_MODE_EAGER,
+        .debounce_scans = 2,
+    };
+
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    keys[1] = 0x10;     // "Z"
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_scan(&kbd_ctx).alpha_num);
+
+    // Chatter on release does not press the key again
+    keys[1] = 0;
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+    keys[1] = 0x10;
+    TEST_ASSERT_EQUAL_UINT8(0xFF, keyboard_scan(&kbd_ctx).alpha_num);
+    keys[1] = 0;
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(1, 4), kbd_ctx.released);
+}
+
+void test_ghost_mask(void)
+{
+    uint64_t l_shape = KEYBOARD_MATRIX_BIT(1, 4) | KEYBOARD_MATRIX_BIT(1, 2) | KEYBOARD_MATRIX_BIT(3, 4);
+    uint64_t rectangle = l_shape | KEYBOARD_MATRIX_BIT(3, 2);
+
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_ghost_mask(0));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_ghost_mask(KEYBOARD_MATRIX_BIT(1, 4) | KEYBOARD_MATRIX_BIT(1, 2)));
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(1, 4), keyboard_ghost_mask(l_shape));
+    TEST_ASSERT_EQUAL_UINT64(rectangle, keyboard_ghost_mask(rectangle));
+
+    // Four keys in four rows and columns can not ghost
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_ghost_mask(KEYBOARD_MATRIX_BIT(0, 0) | KEYBOARD_MATRIX_BIT(1, 1) |
+                                                    KEYBOARD_MATRIX_BIT(2, 2) | KEYBOARD_MATRIX_BIT(3, 3)));
+}
+
+void test_chord_of_four_keys(void)
+{
+    keys[1] = 0x10;     // "Z"
+    keyboard_scan(&kbd_ctx);
+    keys[2] = 0x20;     // "F"
+    keyboard_scan(&kbd_ctx);
+    keys[3] = 0x02;     // "U"
+    keyboard_scan(&kbd_ctx);
+
+    keys[4] = 0x80;     // "N"
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x0E, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL(4, __builtin_popcountll(kbd_ctx.matrix));
+}
+
+void test_pending_overflow_is_counted(void)
+{
+    // One key per row, none of them can be a ghost
+    keys[1] = 0x10;     // "Z"
+    keys[2] = 0x10;     // "C"
+    keys[3] = 0x10;     // "B"
+    keys[4] = 0x10;     // "M"
+    keys[5] = 0x10;     // "."
+    keys[6] = 0x80;     // "/"
+    keys[7] = 0x40;     // "Q"
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(6, kbd_ctx.pending_count);
+    TEST_ASSERT_EQUAL(0, kbd_ctx.pending_drops);
+
+    // Seven more presses, two fit the queue before one is returned
+    for (int row = 1; row < 7; row++)
+        keys[row] = 0x04;   // "A", "D", "G", "J", "L", ";"
+    keys[7] = 0x08;     // "2"
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(KEYBOARD_PENDING_KEYS - 1, kbd_ctx.pending_count);
+    TEST_ASSERT_EQUAL(5, kbd_ctx.pending_drops);
+
+    // The queued keys are still returned one per scan
+    memset(keys, 0, sizeof(keys));
+    for (int i = 0; i < KEYBOARD_PENDING_KEYS - 1; i++)
+        TEST_ASSERT_TRUE(keyboard_scan(&kbd_ctx).alpha_num != 0xFF);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+}
+
+void test_ghost_key_is_suppressed(void)
+{
+    keys[1] = 0x10;     // "Z"
+    keyboard_scan(&kbd_ctx);
+    keys[1] |= 0x04;    // "A"
+    keyboard_scan(&kbd_ctx);
+
+    // "C" in row 2 column 4 makes row 2 column 2 ("D") read as pressed
+    keys[2] = 0x10 | 0x04;
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(1, 4) | KEYBOARD_MATRIX_BIT(1, 2), kbd_ctx.matrix);
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.pressed);
+}
+
+void test_events_posted_in_order(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .events = &event_ring,
+        .timestamp = timestamp,
+    };
+    struct keyboard_event event;
+
+    keyboard_event_ring_init(&event_ring);
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    now = 100;
+    keys[1] = 0x10;     // "Z"
+    keyboard_scan(&kbd_ctx);
+
+    now = 200;
+    keys[1] = 0;
+    keys[2] = 0x20;     // "F"
+    keyboard_scan(&kbd_ctx);
+
+    now = 300;
+    keys[2] = 0;
+    keyboard_scan(&kbd_ctx);
+    keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(4, keyboard_event_count(&event_ring));
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(100, event.timestamp);
+    TEST_ASSERT_EQUAL(12, event.key);
+    TEST_ASSERT_TRUE(event.pressed);
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(200, event.timestamp);
+    TEST_ASSERT_EQUAL(12, event.key);
+    TEST_ASSERT_FALSE(event.pressed);
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(200, event.timestamp);
+    TEST_ASSERT_EQUAL(21, event.key);
+    TEST_ASSERT_TRUE(event.pressed);
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(300, event.timestamp);
+    TEST_ASSERT_EQUAL(21, event.key);
+    TEST_ASSERT_FALSE(event.pressed);
+
+    TEST_ASSERT_FALSE(keyboard_event_get(&event_ring, &event));
+}
+
+void test_incremental_scan_reads_matrix(void)
+{
+    uint32_t seed = 1;
+
+    init_incremental();
+
+    for (int i = 0; i < 500; i++)
+    {
+        // Sparse patterns mostly, dense ones now and then
+        for (int row = 0; row < 8; row++)
+        {
+            seed = seed * 1103515245 + 12345;
+            keys[row] = (seed >> 16) & (seed >> 24) & ((i % 7) ? (seed >> 8) : 0xFF);
+        }
+
+        keyboard_scan(&kbd_ctx);
+        TEST_ASSERT_EQUAL_UINT64(keys_matrix(), kbd_ctx.raw);
+    }
+
+    // Keys still queued are returned before the matrix reads empty
+    memset(keys, 0, sizeof(keys));
+
+    while (kbd_ctx.pending_count)
+        TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+}
+
+void test_incremental_scan_strobes_only_active_rows(void)
+{
+    init_incremental();
+
+    // All rows together
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(1, settle_waits);
+
+    keys[1] = 0x10;     // "Z"
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_scan(&kbd_ctx).alpha_num);
+
+    // Row 1, then the other rows together
+    settle_waits = 0;
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(2, settle_waits);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(1, 4), kbd_ctx.raw);
+
+    keys[2] = 0x20;     // "F"
+    TEST_ASSERT_EQUAL_UINT8(0x06, keyboard_scan(&kbd_ctx).alpha_num);
+
+    settle_waits = 0;
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(3, settle_waits);
+
+    keys[1] = 0;
+    keys[2] = 0;
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+}
+
+void test_reverse_scan_resolves_one_way_ghost(void)
+{
+    init_reverse();
+
+    keys[1] = 0x10;     // "Z"
+    keyboard_scan(&kbd_ctx);
+    keys[1] |= 0x04;    // "A"
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(0, reverse_scans);
+
+    // "D" only reads as pressed with the rows strobed
+    keys[2] = 0x10;     // "C"
+    forward_ghosts[2] = 0x04;
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(1, reverse_scans);
+    TEST_ASSERT_FALSE(reversed);
+    TEST_ASSERT_EQUAL_UINT8(0x03, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL_UINT64(KEYBOARD_MATRIX_BIT(2, 4), kbd_ctx.pressed);
+    TEST_ASSERT_EQUAL_UINT64(keys_matrix(), kbd_ctx.matrix);
+}
+
+void test_reverse_scan_keeps_ambiguous_rectangle(void)
+{
+    init_reverse();
+
+    keys[1] = 0x10;         // "Z"
+    keyboard_scan(&kbd_ctx);
+    keys[1] |= 0x04;        // "A"
+    keyboard_scan(&kbd_ctx);
+    keys[2] = 0x10;         // "C"
+    keyboard_scan(&kbd_ctx);
+
+    // A real fourth key reads the same both ways
+    keys[2] |= 0x04;        // "D"
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(2, reverse_scans);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, keyboard_return.alpha_num);
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.pressed & KEYBOARD_MATRIX_BIT(2, 2));
+}
+
+void test_raw_scan_skips_decoding(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .scan_complete = scan_complete,
+        .events = &event_ring,
+        .timestamp = timestamp,
+        .extra_in_read = extra_in_read,
+    };
+
+    keyboard_event_ring_init(&event_ring);
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    keys[1] = 0x10 | 0x04;  // "Z", "A"
+    keys[7] = 0x80;
+    extra = KEYBOARD_EXTRA_RESTORE;
+    struct keyboard_raw raw;
+
+    TEST_ASSERT_TRUE(keyboard_scan_raw(&kbd_ctx, &raw));
+
+    TEST_ASSERT_EQUAL_UINT64(keys_matrix(), raw.matrix);
+    TEST_ASSERT_EQUAL_UINT8(KEYBOARD_EXTRA_RESTORE, raw.extra);
+    TEST_ASSERT_EQUAL(0, completed_count);
+    TEST_ASSERT_EQUAL(0, keyboard_event_count(&event_ring));
+    TEST_ASSERT_EQUAL_UINT64(0, kbd_ctx.matrix);
+
+    // The decoding scan is unaffected
+    keys[1] = 0x10;
+    keys[7] = 0;
+    extra = 0;
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_scan(&kbd_ctx).alpha_num);
+    TEST_ASSERT_EQUAL(1, completed_count);
+    TEST_ASSERT_EQUAL(1, keyboard_event_count(&event_ring));
+}
+
+void test_extra_rows_posted_as_events(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .events = &event_ring,
+        .profile = &keyboard_profile_c128,
+        .extra_row_read = extra_row_read,
+    };
+    struct keyboard_event event;
+    struct keyboard_raw raw;
+
+    keyboard_event_ring_init(&event_ring);
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    extra_rows[2] = 0x02;   // Keypad "0"
+    TEST_ASSERT_TRUE(keyboard_scan_raw(&kbd_ctx, &raw));
+    TEST_ASSERT_EQUAL_HEX32(0x020000, raw.extra_rows);
+    TEST_ASSERT_EQUAL(0, keyboard_event_count(&event_ring));
+
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_PROFILE_EXTRA_KEY + 17, event.key);
+    TEST_ASSERT_TRUE(event.pressed);
+    TEST_ASSERT_EQUAL_UINT8(0x30, keyboard_profile_key_code(&keyboard_profile_c128, event.key));
+
+    // The matrix is decoded as before
+    keys[1] = 0x10;
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_scan(&kbd_ctx).alpha_num);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(12, event.key);
+
+    extra_rows[2] = 0;
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_PROFILE_EXTRA_KEY + 17, event.key);
+    TEST_ASSERT_FALSE(event.pressed);
+    TEST_ASSERT_FALSE(keyboard_event_get(&event_ring, &event));
+}
+
+void test_extra_lines_posted_as_events(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .events = &event_ring,
+        .extra_in_read = extra_in_read,
+    };
+    struct keyboard_event event;
+    struct keyboard_raw raw;
+
+    keyboard_event_ring_init(&event_ring);
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    // SHIFT LOCK is a level, reported once when engaged
+    extra = KEYBOARD_EXTRA_SHIFT_LOCK;
+    keyboard_scan(&kbd_ctx);
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(1, keyboard_event_count(&event_ring));
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_EXTRA_KEY + 1, event.key);
+    TEST_ASSERT_TRUE(event.pressed);
+    TEST_ASSERT_EQUAL_UINT8(KEYBOARD_EXTRA_SHIFT_LOCK, kbd_ctx.extra_state);
+
+    // RESTORE tapped between two scans
+    keyboard_extra_latch(&kbd_ctx, KEYBOARD_EXTRA_RESTORE);
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(2, keyboard_event_count(&event_ring));
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_EXTRA_KEY + 0, event.key);
+    TEST_ASSERT_TRUE(event.pressed);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_EXTRA_KEY + 0, event.key);
+    TEST_ASSERT_FALSE(event.pressed);
+
+    // RESTORE latched and still down is one press, its release comes with the scan that sees it up
+    extra |= KEYBOARD_EXTRA_RESTORE;
+    keyboard_extra_latch(&kbd_ctx, KEYBOARD_EXTRA_RESTORE);
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(1, keyboard_event_count(&event_ring));
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_TRUE(event.pressed);
+
+    extra = 0;
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(2, keyboard_event_count(&event_ring));
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_EXTRA_KEY + 0, event.key);
+    TEST_ASSERT_FALSE(event.pressed);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(KEYBOARD_EXTRA_KEY + 1, event.key);
+    TEST_ASSERT_FALSE(event.pressed);
+
+    // A raw scan leaves the latch for the next evaluated scan
+    keyboard_extra_latch(&kbd_ctx, KEYBOARD_EXTRA_RESTORE);
+    keyboard_scan_raw(&kbd_ctx, &raw);
+    TEST_ASSERT_EQUAL(0, keyboard_event_count(&event_ring));
+    keyboard_scan(&kbd_ctx);
+    TEST_ASSERT_EQUAL(2, keyboard_event_count(&event_ring));
+}
+
+void test_rollover_within_one_scan(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .events = &event_ring,
+        .timestamp = timestamp,
+    };
+    struct keyboard_event event;
+
+    keyboard_event_ring_init(&event_ring);
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    keyboard_scan(&kbd_ctx);
+
+    // Rows read 100 apart, the press time of a key is taken halfway between the last two
+    // reads of its row. "Z" at 1250 and "O" at 1900 both went down before "X" at 2150.
+    now = 2000;
+    now_step = 100;
+    kbd_ctx.row_time_prev[1] = 400;
+    kbd_ctx.row_time_prev[2] = 2100;
+    kbd_ctx.row_time_prev[4] = 1400;
+    keys[1] = 0x10;     // "Z"
+    keys[2] = 0x80;     // "X"
+    keys[4] = 0x40;     // "O"
+
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_return.alpha_num);
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(12, event.key);
+    TEST_ASSERT_EQUAL(2100, event.timestamp);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(38, event.key);
+    TEST_ASSERT_EQUAL(2400, event.timestamp);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(23, event.key);
+    TEST_ASSERT_EQUAL(2200, event.timestamp);
+
+    // No lockout, the rest are returned while the keys are held and after they are released
+    TEST_ASSERT_EQUAL_UINT8(0x0F, keyboard_scan(&kbd_ctx).alpha_num);
+    memset(keys, 0, sizeof(keys));
+    TEST_ASSERT_EQUAL_UINT8(0x18, keyboard_scan(&kbd_ctx).alpha_num);
+    TEST_ASSERT_EQUAL(SCAN_RETURN_NO_ACTIVITY, keyboard_scan(&kbd_ctx).keyboard_scan_return);
+}
+
+void test_rollover_across_timestamp_wrap(void)
+{
+    const struct keyboard_init_data init =
+    {
+        .pa_cfg_output = pa_cfg_output,
+        .pb_cfg_input_pull_high = pb_cfg_input_pull_high,
+        .pa_out_write = pa_out_write,
+        .pb_in_read = pb_in_read,
+        .events = &event_ring,
+        .timestamp = timestamp_24,
+        .timestamp_mask = 0xFFFFFF,
+    };
+    struct keyboard_event event;
+
+    keyboard_event_ring_init(&event_ring);
+    memset(&kbd_ctx, 0, sizeof(kbd_ctx));
+    keyboard_init(&kbd_ctx, &init);
+
+    keyboard_scan(&kbd_ctx);
+
+    // The count wraps between the reads of rows 1 and 2. "X" at -850 and "O" at -500 both went
+    // down before "Z" at -150, though only the row of "Z" was read before the wrap.
+    now = 0xFFFF38;
+    now_step = 100;
+    kbd_ctx.row_time_prev[1] = 0xFFFF38;
+    kbd_ctx.row_time_prev[2] = 0xFFF95C;
+    kbd_ctx.row_time_prev[4] = 0xFFFB50;
+    keys[1] = 0x10;     // "Z"
+    keys[2] = 0x80;     // "X"
+    keys[4] = 0x40;     // "O"
+
+    struct keyboard_return keyboard_return = keyboard_scan(&kbd_ctx);
+
+    TEST_ASSERT_EQUAL(SCAN_RETURN_SUCCESS, keyboard_return.keyboard_scan_return);
+    TEST_ASSERT_EQUAL_UINT8(0x18, keyboard_return.alpha_num);
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(23, event.key);
+    TEST_ASSERT_EQUAL(0x000000, event.timestamp);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(38, event.key);
+    TEST_ASSERT_EQUAL(0x0000C8, event.timestamp);
+    TEST_ASSERT_TRUE(keyboard_event_get(&event_ring, &event));
+    TEST_ASSERT_EQUAL(12, event.key);
+    TEST_ASSERT_EQUAL(0xFFFF9C, event.timestamp);
+
+    TEST_ASSERT_EQUAL_UINT8(0x0F, keyboard_scan(&kbd_ctx).alpha_num);
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_scan(&kbd_ctx).alpha_num);
+}
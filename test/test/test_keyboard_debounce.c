@@ -0,0 +1,115 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_debounce.h"
+//-- mocked modules
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+
+#define KEY_A   ((uint64_t) 1 << 12)
+#define KEY_B   ((uint64_t) 1 << 63)
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+
+static struct keyboard_debounce_ctx debounce_ctx;
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+    memset(&debounce_ctx, 0, sizeof(debounce_ctx));
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_none_passes_raw(void)
+{
+    keyboard_debounce_init(&debounce_ctx, DEBOUNCE_MODE_NONE, 3);
+
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, 0));
+}
+
+void test_eager_press_deferred_release(void)
+{
+    keyboard_debounce_init(&debounce_ctx, DEBOUNCE_MODE_EAGER, 3);
+
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+
+    // Bounce restarts the release count
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A | KEY_B, keyboard_debounce(&debounce_ctx, KEY_A | KEY_B));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A | KEY_B, keyboard_debounce(&debounce_ctx, KEY_B));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A | KEY_B, keyboard_debounce(&debounce_ctx, KEY_B));
+    TEST_ASSERT_EQUAL_UINT64(KEY_B, keyboard_debounce(&debounce_ctx, KEY_B));
+}
+
+void test_defer_press_and_release(void)
+{
+    keyboard_debounce_init(&debounce_ctx, DEBOUNCE_MODE_DEFER, 2);
+
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, 0));
+}
+
+void test_integrator_hysteresis(void)
+{
+    keyboard_debounce_init(&debounce_ctx, DEBOUNCE_MODE_INTEGRATOR, 3);
+
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+
+    // Saturated, a single bounce does not release
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, keyboard_debounce(&debounce_ctx, 0));
+}
+
+void test_scans_are_limited(void)
+{
+    keyboard_debounce_init(&debounce_ctx, DEBOUNCE_MODE_DEFER, 0);
+    TEST_ASSERT_EQUAL(1, debounce_ctx.scans);
+    TEST_ASSERT_EQUAL_UINT64(KEY_A, keyboard_debounce(&debounce_ctx, KEY_A));
+
+    keyboard_debounce_init(&debounce_ctx, DEBOUNCE_MODE_DEFER, 100);
+    TEST_ASSERT_EQUAL(KEYBOARD_DEBOUNCE_MAX_SCANS, debounce_ctx.scans);
+}
@@ -0,0 +1,121 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_event.h"
+//-- mocked modules
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+
+static struct keyboard_event_ring ring;
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+
+static bool put(uint8_t key)
+{
+    struct keyboard_event event =
+    {
+        .timestamp = key * 10,
+        .key = key,
+        .pressed = true,
+    };
+
+    return keyboard_event_put(&ring, &event);
+}
+
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+    keyboard_event_ring_init(&ring);
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_empty_ring(void)
+{
+    struct keyboard_event event;
+
+    TEST_ASSERT_EQUAL(0, keyboard_event_count(&ring));
+    TEST_ASSERT_FALSE(keyboard_event_get(&ring, &event));
+}
+
+void test_fifo_order(void)
+{
+    struct keyboard_event event;
+
+    TEST_ASSERT_TRUE(put(1));
+    TEST_ASSERT_TRUE(put(2));
+    TEST_ASSERT_EQUAL(2, keyboard_event_count(&ring));
+
+    TEST_ASSERT_TRUE(keyboard_event_get(&ring, &event));
+    TEST_ASSERT_EQUAL(1, event.key);
+    TEST_ASSERT_EQUAL(10, event.timestamp);
+    TEST_ASSERT_TRUE(keyboard_event_get(&ring, &event));
+    TEST_ASSERT_EQUAL(2, event.key);
+    TEST_ASSERT_FALSE(keyboard_event_get(&ring, &event));
+}
+
+void test_overflow_is_counted(void)
+{
+    struct keyboard_event event;
+
+    for (int i = 0; i < KEYBOARD_EVENT_RING_SIZE; i++)
+        TEST_ASSERT_TRUE(put(i));
+
+    TEST_ASSERT_FALSE(put(0xFF));
+    TEST_ASSERT_FALSE(put(0xFF));
+    TEST_ASSERT_EQUAL(2, ring.overflows);
+    TEST_ASSERT_EQUAL(KEYBOARD_EVENT_RING_SIZE, keyboard_event_count(&ring));
+
+    // Oldest events are kept, room is made by the consumer
+    TEST_ASSERT_TRUE(keyboard_event_get(&ring, &event));
+    TEST_ASSERT_EQUAL(0, event.key);
+    TEST_ASSERT_TRUE(put(0x40));
+}
+
+void test_indexes_wrap(void)
+{
+    struct keyboard_event event;
+
+    ring.head = UINT32_MAX - 1;
+    ring.tail = UINT32_MAX - 1;
+
+    for (int i = 0; i < 4; i++)
+        TEST_ASSERT_TRUE(put(i));
+
+    TEST_ASSERT_EQUAL(4, keyboard_event_count(&ring));
+
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(keyboard_event_get(&ring, &event));
+        TEST_ASSERT_EQUAL(i, event.key);
+    }
+}
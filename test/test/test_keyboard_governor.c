@@ -0,0 +1,146 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_governor.h"
+//-- mocked modules
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+
+static const struct keyboard_governor_tier tiers[] =
+{
+    { 1, 10 },
+    { 8, 80 },
+    { 0, 0 },
+};
+
+static struct keyboard_governor_ctx governor;
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+
+// Scan at the tier interval
+static bool governor_update(uint64_t raw)
+{
+    return keyboard_governor_update(&governor, raw, keyboard_governor_interval(&governor));
+}
+
+// Scans an unchanged matrix until the tier changes, returns the number of scans
+static int scan_until_change(uint64_t raw)
+{
+    int scans = 1;
+
+    while (!governor_update(raw))
+    {
+        if (++scans > 1000)
+            break;
+    }
+
+    return scans;
+}
+
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+    keyboard_governor_init(&governor, tiers, 3);
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_starts_at_fastest_tier(void)
+{
+    TEST_ASSERT_EQUAL(1, keyboard_governor_interval(&governor));
+    TEST_ASSERT_FALSE(keyboard_governor_parked(&governor));
+}
+
+void test_steps_down_after_hold_time(void)
+{
+    TEST_ASSERT_EQUAL(10, scan_until_change(0));
+    TEST_ASSERT_EQUAL(8, keyboard_governor_interval(&governor));
+
+    TEST_ASSERT_EQUAL(10, scan_until_change(0));
+    TEST_ASSERT_TRUE(keyboard_governor_parked(&governor));
+}
+
+void test_change_returns_to_fastest_tier(void)
+{
+    scan_until_change(0);
+    TEST_ASSERT_EQUAL(8, keyboard_governor_interval(&governor));
+
+    TEST_ASSERT_TRUE(governor_update(0x01));
+    TEST_ASSERT_EQUAL(1, keyboard_governor_interval(&governor));
+
+    // Hold time starts over after the change
+    TEST_ASSERT_EQUAL(10, scan_until_change(0x01));
+}
+
+void test_change_at_fastest_tier_restarts_hold_time(void)
+{
+    for (int i = 0; i < 9; i++)
+        TEST_ASSERT_FALSE(governor_update(0));
+
+    TEST_ASSERT_FALSE(governor_update(0x01));
+    TEST_ASSERT_EQUAL(10, scan_until_change(0x01));
+}
+
+void test_hold_counts_elapsed_time(void)
+{
+    // Scans paced at 5 rather than the tier interval of 1 leave the tier after 2 scans
+    TEST_ASSERT_FALSE(keyboard_governor_update(&governor, 0, 5));
+    TEST_ASSERT_TRUE(keyboard_governor_update(&governor, 0, 5));
+    TEST_ASSERT_EQUAL(8, keyboard_governor_interval(&governor));
+}
+
+void test_held_key_does_not_park(void)
+{
+    scan_until_change(0x01);
+    TEST_ASSERT_EQUAL(8, keyboard_governor_interval(&governor));
+
+    for (int i = 0; i < 100; i++)
+        TEST_ASSERT_FALSE(governor_update(0x01));
+
+    TEST_ASSERT_FALSE(keyboard_governor_parked(&governor));
+
+    // Parks once the key is released and the hold time has passed again
+    TEST_ASSERT_TRUE(governor_update(0));
+    scan_until_change(0);
+    TEST_ASSERT_EQUAL(10, scan_until_change(0));
+    TEST_ASSERT_TRUE(keyboard_governor_parked(&governor));
+}
+
+void test_wake_from_park(void)
+{
+    scan_until_change(0);
+    scan_until_change(0);
+    TEST_ASSERT_TRUE(keyboard_governor_parked(&governor));
+
+    TEST_ASSERT_TRUE(keyboard_governor_wake(&governor));
+    TEST_ASSERT_EQUAL(1, keyboard_governor_interval(&governor));
+    TEST_ASSERT_FALSE(keyboard_governor_wake(&governor));
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_portmap.h"
+//-- mocked modules
+
+#include "boards.h"
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+
+static const uint32_t porta_pins[] = { PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7 };
+static const uint32_t portb_pins[] = { PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7 };
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+
+// Reference mapping, one pin at a time
+static uint32_t reference_scatter(const uint32_t* pins, int port, uint8_t value)
+{
+    uint32_t msk = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        if ((value & (1 << i)) && (pins[i] >> 5) == port)
+            msk |= 1u << (pins[i] & 0x1F);
+    }
+
+    return msk;
+}
+
+static uint8_t reference_gather(const uint32_t* pins, int port, uint32_t in)
+{
+    uint8_t value = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        if ((pins[i] >> 5) == port && (in & (1u << (pins[i] & 0x1F))))
+            value |= 1 << i;
+    }
+
+    return value;
+}
+
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_pa_scatter_matches_reference(void)
+{
+    for (int value = 0; value < 256; value++)
+    {
+        TEST_ASSERT_EQUAL_HEX32(reference_scatter(porta_pins, 0, value),
+                                keyboard_portmap_scatter(keyboard_portmap_pa_p0, value));
+        TEST_ASSERT_EQUAL_HEX32(reference_scatter(porta_pins, 1, value),
+                                keyboard_portmap_scatter(keyboard_portmap_pa_p1, value));
+    }
+}
+
+void test_pb_scatter_matches_reference(void)
+{
+    for (int value = 0; value < 256; value++)
+    {
+        TEST_ASSERT_EQUAL_HEX32(reference_scatter(portb_pins, 0, value),
+                                keyboard_portmap_scatter(keyboard_portmap_pb_out_p0, value));
+        TEST_ASSERT_EQUAL_HEX32(reference_scatter(portb_pins, 1, value),
+                                keyboard_portmap_scatter(keyboard_portmap_pb_out_p1, value));
+    }
+}
+
+void test_pb_gather_matches_reference(void)
+{
+    // Every PB value, with all other port pins both low and high
+    for (int value = 0; value < 256; value++)
+    {
+        for (int port = 0; port < 2; port++)
+        {
+            const uint8_t (*table)[256] = port ? keyboard_portmap_pb_p1 : keyboard_portmap_pb_p0;
+            uint32_t in = reference_scatter(portb_pins, port, value);
+            uint32_t others = ~reference_scatter(portb_pins, port, 0xFF);
+
+            TEST_ASSERT_EQUAL_HEX8(reference_gather(portb_pins, port, in), keyboard_portmap_gather(table, in));
+            TEST_ASSERT_EQUAL_HEX8(reference_gather(portb_pins, port, in | others), keyboard_portmap_gather(table, in | others));
+        }
+    }
+}
+
+void test_single_port_pins_gather(void)
+{
+    for (int pin = 0; pin < 32; pin++)
+    {
+        uint32_t in = 1u << pin;
+
+        TEST_ASSERT_EQUAL_HEX8(reference_gather(porta_pins, 0, in), keyboard_portmap_gather(keyboard_portmap_pa_in_p0, in));
+        TEST_ASSERT_EQUAL_HEX8(reference_gather(porta_pins, 1, in), keyboard_portmap_gather(keyboard_portmap_pa_in_p1, in));
+        TEST_ASSERT_EQUAL_HEX8(reference_gather(portb_pins, 0, in), keyboard_portmap_gather(keyboard_portmap_pb_p0, in));
+        TEST_ASSERT_EQUAL_HEX8(reference_gather(portb_pins, 1, in), keyboard_portmap_gather(keyboard_portmap_pb_p1, in));
+    }
+}
@@ -0,0 +1,94 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_profile.h"
+//-- mocked modules
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+
+#define MATRIX_BIT(row, column)     ((uint64_t) 1 << (8 * (row) + (column)))
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_c64_decode(void)
+{
+    const struct keyboard_profile* profile = &keyboard_profile_c64;
+
+    TEST_ASSERT_EQUAL_UINT8(0x1A, keyboard_profile_key_code(profile, 8 * 1 + 4));   // "Z"
+    TEST_ASSERT_EQUAL_UINT8(0x06, keyboard_profile_key_code(profile, 8 * 2 + 5));   // "F"
+    TEST_ASSERT_EQUAL_UINT8(0xFF, keyboard_profile_key_code(profile, 8 * 1 + 7));   // Left SHIFT
+    TEST_ASSERT_EQUAL_UINT8(0x1D, keyboard_profile_usage(profile, 8 * 1 + 4));      // "Z"
+    TEST_ASSERT_EQUAL_UINT8(0x2A, keyboard_profile_usage(profile, 8 * 0 + 0));      // INST DEL
+    TEST_ASSERT_EQUAL_UINT8(0, keyboard_profile_usage(profile, 8 * 1 + 7));         // Left SHIFT
+
+    TEST_ASSERT_EQUAL_UINT8(0x40, keyboard_profile_flag_y(profile, MATRIX_BIT(1, 7)));
+    TEST_ASSERT_EQUAL_UINT8(0xA4, keyboard_profile_flag_y(profile, 0xFFull << 56));
+    TEST_ASSERT_EQUAL_UINT8(0x18, keyboard_profile_flag_y(profile, 0xFFull << 48));
+    TEST_ASSERT_EQUAL_UINT8(0, keyboard_profile_flag_y(profile, MATRIX_BIT(1, 4)));
+    TEST_ASSERT_EQUAL_UINT8(0x41, keyboard_profile_flag_x(profile, MATRIX_BIT(0, 6) | MATRIX_BIT(0, 0)));
+}
+
+void test_alpha_mask(void)
+{
+    // Row 0 and SHIFT, RUN STOP, C=, CTRL, right SHIFT and HOME
+    TEST_ASSERT_EQUAL(64 - 8 - 6, __builtin_popcountll(keyboard_profile_alpha_mask(&keyboard_profile_c64)));
+    TEST_ASSERT_EQUAL_UINT64(keyboard_profile_alpha_mask(&keyboard_profile_c64), keyboard_profile_alpha_mask(&keyboard_profile_c128));
+    TEST_ASSERT_FALSE(keyboard_profile_alpha_mask(&keyboard_profile_c16) & MATRIX_BIT(5, 0));   // CRSR DOWN
+    TEST_ASSERT_TRUE(keyboard_profile_alpha_mask(&keyboard_profile_c16) & MATRIX_BIT(0, 7));    // "@"
+}
+
+void test_c128_extra_rows(void)
+{
+    const struct keyboard_profile* profile = &keyboard_profile_c128;
+
+    TEST_ASSERT_EQUAL(3, profile->extra_rows);
+    TEST_ASSERT_TRUE(profile->extra_rows <= KEYBOARD_PROFILE_MAX_EXTRA_ROWS);
+    TEST_ASSERT_EQUAL_UINT8(0x31, keyboard_profile_key_code(profile, KEYBOARD_PROFILE_EXTRA_KEY + 8 * 0 + 7));  // Keypad "1"
+    TEST_ASSERT_EQUAL_UINT8(0x2B, keyboard_profile_key_code(profile, KEYBOARD_PROFILE_EXTRA_KEY + 8 * 1 + 1));  // Keypad "+"
+    TEST_ASSERT_EQUAL_UINT8(0xFF, keyboard_profile_key_code(profile, KEYBOARD_PROFILE_EXTRA_KEY + 8 * 2 + 0));  // ALT
+}
+
+void test_c16_flags(void)
+{
+    const struct keyboard_profile* profile = &keyboard_profile_c16;
+
+    TEST_ASSERT_EQUAL_UINT8(0x40, keyboard_profile_flag_y(profile, MATRIX_BIT(1, 7)));
+    TEST_ASSERT_EQUAL_UINT8(0xAC, keyboard_profile_flag_y(profile, 0xFFull << 56));
+    TEST_ASSERT_EQUAL_UINT8(0, keyboard_profile_flag_y(profile, 0xFFull << 48));
+    TEST_ASSERT_EQUAL_UINT8(0x10, keyboard_profile_key_code(profile, 8 * 5 + 1));   // "P"
+}
@@ -0,0 +1,302 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_report.h"
+#include "keyboard_event.h"
+#include "keyboard_profile.h"
+//-- mocked modules
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+
+#define KEY(row, column)    (8 * (row) + (column))
+
+// KEYBOARD_EXTRA_KEY and the line bits, keyboard.h is not linked
+#define EXTRA_KEY           (KEYBOARD_PROFILE_EXTRA_KEY + 8 * KEYBOARD_PROFILE_MAX_EXTRA_ROWS)
+#define EXTRA_RESTORE       0
+#define EXTRA_SHIFT_LOCK    1
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+
+static struct keyboard_report_ctx ctx;
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+
+static void key(unsigned int key, bool pressed)
+{
+    struct keyboard_event event = { .key = key, .pressed = pressed };
+
+    keyboard_report_event(&ctx, &event);
+}
+ 
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+    keyboard_report_init(&ctx, &keyboard_profile_c64);
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_key_and_modifiers(void)
+{
+    const uint8_t expected[] = {KEYBOARD_REPORT_LEFT_SHIFT | KEYBOARD_REPORT_LEFT_CTRL, 0, 0x1D, 0, 0, 0, 0, 0};
+
+    key(KEY(1, 7), true);   // Left SHIFT
+    key(KEY(7, 2), true);   // CTRL
+    key(KEY(1, 4), true);   // "Z"
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, ctx.report, KEYBOARD_REPORT_SIZE);
+}
+
+void test_only_changes_reported(void)
+{
+    const uint8_t released[KEYBOARD_REPORT_SIZE] = {0};
+
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+
+    key(KEY(2, 5), true);   // "F"
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0x09, ctx.report[2]);
+
+    key(KEY(2, 5), false);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(released, ctx.report, KEYBOARD_REPORT_SIZE);
+}
+
+void test_rollover_error(void)
+{
+    // "1" to "7", and SHIFT which is a modifier and takes no slot
+    unsigned int keys[] = {KEY(7, 0), KEY(7, 3), KEY(1, 0), KEY(1, 3), KEY(2, 0), KEY(2, 3), KEY(3, 0)};
+
+    key(KEY(1, 7), true);
+    for (int i = 0; i < 6; i++)
+        key(keys[i], true);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(KEYBOARD_REPORT_LEFT_SHIFT, ctx.report[0]);
+    for (int i = 2; i < KEYBOARD_REPORT_SIZE; i++)
+        TEST_ASSERT_TRUE(ctx.report[i] >= 0x1E && ctx.report[i] <= 0x23);
+
+    key(keys[6], true);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(KEYBOARD_REPORT_LEFT_SHIFT, ctx.report[0]);
+    TEST_ASSERT_EACH_EQUAL_UINT8(KEYBOARD_REPORT_ERROR_ROLLOVER, &ctx.report[2], KEYBOARD_REPORT_KEYS);
+}
+
+void test_extra_lines(void)
+{
+    key(EXTRA_KEY + EXTRA_SHIFT_LOCK, true);
+    key(EXTRA_KEY + EXTRA_RESTORE, true);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(KEYBOARD_REPORT_LEFT_SHIFT, ctx.report[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x4B, ctx.report[2]);
+
+    key(EXTRA_KEY + EXTRA_RESTORE, false);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0, ctx.report[2]);
+}
+
+void test_c128_extra_rows(void)
+{
+    keyboard_report_init(&ctx, &keyboard_profile_c128);
+
+    key(KEYBOARD_PROFILE_EXTRA_KEY + 8 * 0 + 7, true);  // Keypad "1"
+    key(KEYBOARD_PROFILE_EXTRA_KEY + 8 * 2 + 0, true);  // ALT
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0x40, ctx.report[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x59, ctx.report[2]);
+    TEST_ASSERT_EQUAL_UINT8(0, ctx.report[3]);
+}
+
+void test_nkro_bitmap(void)
+{
+    // "1" to "8"
+    unsigned int keys[] = {KEY(7, 0), KEY(7, 3), KEY(1, 0), KEY(1, 3), KEY(2, 0), KEY(2, 3), KEY(3, 0), KEY(3, 3)};
+    const uint8_t expected[KEYBOARD_REPORT_NKRO_SIZE] = {KEYBOARD_REPORT_LEFT_SHIFT, [1 + 0x1E / 8] = 0xC0, [1 + 0x20 / 8] = 0x3F};
+
+    keyboard_report_nkro(&ctx, true);
+    key(KEY(1, 7), true);
+    for (int i = 0; i < 8; i++)
+        key(keys[i], true);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, ctx.nkro_report, KEYBOARD_REPORT_NKRO_SIZE);
+
+    // 6KRO report is kept up to date for a switch back
+    TEST_ASSERT_EACH_EQUAL_UINT8(KEYBOARD_REPORT_ERROR_ROLLOVER, &ctx.report[2], KEYBOARD_REPORT_KEYS);
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+}
+
+void test_nkro_shared_usage(void)
+{
+    keyboard_report_init(&ctx, &keyboard_profile_c128);
+    keyboard_report_nkro(&ctx, true);
+
+    // CRSR RIGHT and the K2 RIGHT key
+    key(KEY(0, 2), true);
+    key(KEYBOARD_PROFILE_EXTRA_KEY + 8 * 2 + 6, true);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    key(KEY(0, 2), false);
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(1 << (0x4F % 8), ctx.nkro_report[1 + 0x4F / 8]);
+}
+
+void test_nkro_switch_moves_keys_down(void)
+{
+    const uint8_t released[KEYBOARD_REPORT_NKRO_SIZE] = {0};
+
+    key(KEY(2, 5), true);   // "F"
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+
+    // Released on the 6-key report, then down on the bitmap
+    keyboard_report_nkro(&ctx, true);
+    TEST_ASSERT_TRUE(keyboard_report_pending(&ctx));
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_FALSE(ctx.nkro);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(released, ctx.report, KEYBOARD_REPORT_SIZE);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_TRUE(ctx.nkro);
+    TEST_ASSERT_EQUAL_UINT8(1 << (0x09 % 8), ctx.nkro_report[1 + 0x09 / 8]);
+    TEST_ASSERT_FALSE(keyboard_report_pending(&ctx));
+
+    // And back, with a change queued meanwhile
+    keyboard_report_nkro(&ctx, false);
+    key(KEY(1, 7), true);   // Left SHIFT
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_TRUE(ctx.nkro);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(released, ctx.nkro_report, KEYBOARD_REPORT_NKRO_SIZE);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_FALSE(ctx.nkro);
+    TEST_ASSERT_EQUAL_UINT8(KEYBOARD_REPORT_LEFT_SHIFT, ctx.report[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x09, ctx.report[2]);
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+}
+
+void test_nkro_switch_without_keys_down(void)
+{
+    keyboard_report_nkro(&ctx, true);
+    TEST_ASSERT_TRUE(keyboard_report_pending(&ctx));
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+    TEST_ASSERT_TRUE(ctx.nkro);
+    TEST_ASSERT_FALSE(keyboard_report_pending(&ctx));
+}
+
+void test_boot_switch_releases_on_old_report(void)
+{
+    const uint8_t released[KEYBOARD_REPORT_NKRO_SIZE] = {0};
+
+    keyboard_report_nkro(&ctx, true);
+    key(KEY(2, 5), true);   // "F"
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_TRUE(ctx.nkro);
+
+    // Boot protocol has the 6-key report only, the keys are released on the bitmap first
+    keyboard_report_boot(&ctx, true);
+    keyboard_report_nkro(&ctx, false);
+    TEST_ASSERT_TRUE(keyboard_report_pending(&ctx));
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_TRUE(ctx.nkro);
+    TEST_ASSERT_FALSE(ctx.boot);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(released, ctx.nkro_report, KEYBOARD_REPORT_NKRO_SIZE);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_FALSE(ctx.nkro);
+    TEST_ASSERT_TRUE(ctx.boot);
+    TEST_ASSERT_EQUAL_UINT8(0x09, ctx.report[2]);
+
+    // Back to report protocol without the bitmap, released on the boot report first
+    keyboard_report_boot(&ctx, false);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_TRUE(ctx.boot);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(released, ctx.report, KEYBOARD_REPORT_SIZE);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_FALSE(ctx.boot);
+    TEST_ASSERT_EQUAL_UINT8(0x09, ctx.report[2]);
+    TEST_ASSERT_FALSE(keyboard_report_pending(&ctx));
+}
+
+void test_coalesce_superseded(void)
+{
+    // "A" and "S" down before the report could be sent
+    key(KEY(1, 2), true);
+    key(KEY(1, 5), true);
+    TEST_ASSERT_TRUE(keyboard_report_pending(&ctx));
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0x04, ctx.report[2]);
+    TEST_ASSERT_EQUAL_UINT8(0x16, ctx.report[3]);
+    TEST_ASSERT_FALSE(keyboard_report_pending(&ctx));
+}
+
+void test_coalesce_keeps_tap(void)
+{
+    // "A" pressed and released, then "S" pressed
+    key(KEY(1, 2), true);
+    key(KEY(1, 2), false);
+    key(KEY(1, 5), true);
+
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0x04, ctx.report[2]);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0x16, ctx.report[2]);
+    TEST_ASSERT_FALSE(keyboard_report_pending(&ctx));
+}
+
+void test_coalesce_keeps_release(void)
+{
+    key(KEY(1, 2), true);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+
+    // "A" released and pressed again
+    key(KEY(1, 2), false);
+    key(KEY(1, 2), true);
+
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0, ctx.report[2]);
+    TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+    TEST_ASSERT_EQUAL_UINT8(0x04, ctx.report[2]);
+    TEST_ASSERT_FALSE(keyboard_report_build(&ctx));
+}
+
+void test_full_queue_keeps_release(void)
+{
+    // "A" tapped faster than reports can be sent, ending down
+    for (int i = 0; i < KEYBOARD_REPORT_QUEUE; i++)
+        key(KEY(1, 2), i % 2 == 0);
+    key(KEY(1, 2), true);
+
+    TEST_ASSERT_EQUAL(KEYBOARD_REPORT_QUEUE, ctx.stats.queue_max);
+    TEST_ASSERT_EQUAL(1, ctx.stats.collapsed);
+
+    // Every report alternates, the release before the last press is kept
+    for (int i = 0; i < KEYBOARD_REPORT_QUEUE + 1; i++)
+    {
+        TEST_ASSERT_TRUE(keyboard_report_build(&ctx));
+        TEST_ASSERT_EQUAL_UINT8(i % 2 == 0 ? 0x04 : 0, ctx.report[2]);
+    }
+
+    TEST_ASSERT_FALSE(keyboard_report_pending(&ctx));
+}
@@ -0,0 +1,153 @@
+/*******************************************************************************
+ *    INCLUDED FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+//-- unity: unit test framework
+#include "unity.h"
+ 
+//-- module being tested
+#include "keyboard_settle.h"
+//-- mocked modules
+ 
+/*******************************************************************************
+ *    DEFINITIONS
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE TYPES
+ ******************************************************************************/
+ 
+/*******************************************************************************
+ *    PRIVATE DATA
+ ******************************************************************************/
+
+// Model of the matrix, columns read low until a row has settled
+static uint16_t threshold_us[KEYBOARD_SETTLE_ROWS];
+static uint8_t settled[KEYBOARD_SETTLE_ROWS];
+static int probes;
+static int change_after;        // Probe count after which the settled value changes, 0 never
+
+static uint8_t probe(uint8_t pa, uint16_t delay_us);
+
+static const struct keyboard_settle_init_data init =
+{
+    .probe = probe,
+    .max_us = 100,
+    .step_us = 2,
+    .repeats = 3,
+    .margin_us = 2,
+};
+
+static struct keyboard_settle_ctx settle;
+ 
+/*******************************************************************************
+ *    PRIVATE FUNCTIONS
+ ******************************************************************************/
+
+static int probe_row(uint8_t pa)
+{
+    for (int row = 0; row < 8; row++)
+    {
+        if (pa == (uint8_t) ~(1 << row))
+            return row;
+    }
+
+    TEST_ASSERT_EQUAL_HEX8(0x00, pa);
+    return KEYBOARD_SETTLE_ALL_ROWS;
+}
+
+static uint8_t probe(uint8_t pa, uint16_t delay_us)
+{
+    int row = probe_row(pa);
+    uint8_t value = settled[row];
+
+    if (change_after && ++probes > change_after)
+        value ^= 0x01;
+
+    return delay_us >= threshold_us[row] ? value : 0x00;
+}
+
+/*******************************************************************************
+ *    SETUP, TEARDOWN
+ ******************************************************************************/
+ 
+void setUp(void)
+{
+    for (int row = 0; row < KEYBOARD_SETTLE_ROWS; row++)
+    {
+        threshold_us[row] = 10;
+        settled[row] = 0xFF;
+    }
+
+    probes = 0;
+    change_after = 0;
+}
+ 
+void tearDown(void)
+{
+}
+ 
+/*******************************************************************************
+ *    TESTS
+ ******************************************************************************/
+
+void test_rows_calibrate_independently(void)
+{
+    threshold_us[0] = 3;
+    threshold_us[5] = 20;
+    settled[5] = 0xEF;
+    threshold_us[KEYBOARD_SETTLE_ALL_ROWS] = 30;
+
+    TEST_ASSERT_TRUE(keyboard_settle_calibrate(&settle, &init));
+
+    // Shortest safe delay, plus half, plus margin
+    TEST_ASSERT_EQUAL(4 + 2 + 2, settle.settle_us[0]);
+    TEST_ASSERT_EQUAL(10 + 5 + 2, settle.settle_us[1]);
+    TEST_ASSERT_EQUAL(20 + 10 + 2, settle.settle_us[5]);
+    TEST_ASSERT_EQUAL(30 + 15 + 2, settle.settle_us[KEYBOARD_SETTLE_ALL_ROWS]);
+    TEST_ASSERT_EQUAL(47, keyboard_settle_max_us(&settle));
+}
+
+void test_settle_is_limited_to_max(void)
+{
+    threshold_us[2] = 90;
+
+    TEST_ASSERT_TRUE(keyboard_settle_calibrate(&settle, &init));
+    TEST_ASSERT_EQUAL(100, settle.settle_us[2]);
+}
+
+void test_instant_row_keeps_margin(void)
+{
+    threshold_us[3] = 0;
+
+    TEST_ASSERT_TRUE(keyboard_settle_calibrate(&settle, &init));
+    TEST_ASSERT_EQUAL(2, settle.settle_us[3]);
+}
+
+void test_changing_keys_fail_calibration(void)
+{
+    change_after = 5;
+
+    TEST_ASSERT_FALSE(keyboard_settle_calibrate(&settle, &init));
+    TEST_ASSERT_EQUAL(100, settle.settle_us[0]);
+}
+
+void test_default_and_total(void)
+{
+    keyboard_settle_default(&settle, 10);
+
+    TEST_ASSERT_EQUAL(10, keyboard_settle_max_us(&settle));
+    TEST_ASSERT_EQUAL(10 * KEYBOARD_SETTLE_ROWS, keyboard_settle_total_us(&settle));
+}
+
+void test_pass_waits_period_or_settle(void)
+{
+    keyboard_settle_default(&settle, 10);
+    settle.settle_us[KEYBOARD_SETTLE_ALL_ROWS] = 200;
+
+    TEST_ASSERT_EQUAL(keyboard_settle_total_us(&settle), keyboard_settle_pass_us(&settle, 0));
+    // Rows settling within the period wait the whole period, the slow row its settle time
+    TEST_ASSERT_EQUAL(8 * 150 + 200, keyboard_settle_pass_us(&settle, 150));
+}